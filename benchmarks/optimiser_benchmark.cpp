@@ -0,0 +1,121 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <sightread/songparts.hpp>
+
+#include "optimiser.hpp"
+
+namespace {
+// A synthetic guitar chart: a note every eighth, with an SP phrase every few
+// notes and every fourth phrase on a sustain, so the search has whammy to deal
+// with as well as plenty of overlapping activations to choose between.
+SightRead::NoteTrack make_note_track(int note_count)
+{
+    constexpr int TICKS_PER_NOTE = 96;
+    constexpr int NOTES_PER_PHRASE = 24;
+    constexpr int PHRASES_PER_SUSTAIN = 4;
+    constexpr int SUSTAIN_LENGTH = 4 * TICKS_PER_NOTE;
+
+    std::vector<SightRead::Note> notes;
+    std::vector<SightRead::StarPower> phrases;
+    for (auto i = 0; i < note_count; ++i) {
+        SightRead::Note note;
+        note.position = SightRead::Tick {i * TICKS_PER_NOTE};
+        note.flags = SightRead::FLAGS_FIVE_FRET_GUITAR;
+        note.lengths[SightRead::FIVE_FRET_GREEN] = SightRead::Tick {0};
+        if (i % NOTES_PER_PHRASE == 0) {
+            const auto phrase = i / NOTES_PER_PHRASE;
+            if (phrase % PHRASES_PER_SUSTAIN == PHRASES_PER_SUSTAIN - 1) {
+                note.lengths[SightRead::FIVE_FRET_GREEN]
+                    = SightRead::Tick {SUSTAIN_LENGTH};
+                i += SUSTAIN_LENGTH / TICKS_PER_NOTE;
+            }
+            phrases.push_back({note.position, SightRead::Tick {1}});
+        }
+        notes.push_back(note);
+    }
+    return {notes, phrases, SightRead::TrackType::FiveFret,
+            std::make_shared<SightRead::SongGlobalData>()};
+}
+
+void print_run(const ProcessedSong& track, const OptimiserSettings& settings)
+{
+    const std::atomic<bool> terminate {false};
+    const Optimiser optimiser {&track, &terminate, 100, SightRead::Second(0.0),
+                               settings};
+    SearchStats stats;
+    const auto path = optimiser.optimal_path(&stats);
+    std::printf("%8d %12d %12.3f %12.3f %14llu %14llu %10.1f %12llu %12llu\n",
+                settings.threads, path.score_boost, stats.search_time.count(),
+                stats.reconstruction_time.count(),
+                static_cast<unsigned long long>(stats.subproblems_solved),
+                static_cast<unsigned long long>(stats.candidates_scored),
+                static_cast<double>(stats.peak_cache_bytes) / (1024 * 1024),
+                static_cast<unsigned long long>(stats.prefetched_lists_taken),
+                static_cast<unsigned long long>(
+                    stats.prefetched_lists_evicted));
+#ifdef CHOPT_DETAILED_STATS
+    std::printf("%8s %llu activations checked in path reconstruction\n", "",
+                static_cast<unsigned long long>(
+                    stats.reconstruction_acts_checked));
+#endif
+}
+}
+
+// Times the optimiser on the same chart with one thread and with more, so the
+// speedup from threading can be read off and any change in the score spotted.
+int main(int argc, char** argv)
+{
+    constexpr int DEFAULT_NOTE_COUNT = 2000;
+    constexpr int DEFAULT_MAX_THREADS = 4;
+
+    const auto note_count
+        = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_NOTE_COUNT;
+    const auto max_threads
+        = (argc > 2) ? std::atoi(argv[2]) : DEFAULT_MAX_THREADS;
+    if (note_count < 1 || max_threads < 1) {
+        std::fputs("Note and thread counts must be positive\n", stderr);
+        return EXIT_FAILURE;
+    }
+    const auto note_track = make_note_track(note_count);
+    const ProcessedSong track {note_track,
+                               {{}, SpMode::Measure},
+                               SqueezeSettings::default_settings(),
+                               SightRead::DrumSettings::default_settings(),
+                               ChGuitarEngine(),
+                               {},
+                               {}};
+
+    std::printf("%d notes\n", note_count);
+    std::printf("%8s %12s %12s %12s %14s %14s %10s %12s %12s\n", "threads",
+                "score", "search s", "rebuild s", "subproblems", "candidates",
+                "cache MB", "prefetched", "evicted");
+    for (auto threads = 1; threads <= max_threads; threads *= 2) {
+        OptimiserSettings settings;
+        settings.threads = threads;
+        print_run(track, settings);
+    }
+    return EXIT_SUCCESS;
+}
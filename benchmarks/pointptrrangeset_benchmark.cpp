@@ -0,0 +1,208 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <tuple>
+#include <vector>
+
+#include "pointptrrangeset.hpp"
+
+namespace {
+// The implementation PointPtrRangeSet replaced, kept to compare against.
+class LinearPointPtrRangeSet {
+private:
+    PointPtr m_start;
+    PointPtr m_end;
+    PointPtr m_min_absent_ptr;
+    std::vector<PointPtr> m_abnormal_elements;
+
+public:
+    LinearPointPtrRangeSet(PointPtr start, PointPtr end)
+        : m_start {start}
+        , m_end {end}
+        , m_min_absent_ptr {start}
+    {
+    }
+
+    [[nodiscard]] bool contains(PointPtr element) const
+    {
+        if (m_start > element || m_end <= element) {
+            return false;
+        }
+        if (element < m_min_absent_ptr) {
+            return true;
+        }
+        return std::find(m_abnormal_elements.cbegin(),
+                         m_abnormal_elements.cend(), element)
+            != m_abnormal_elements.cend();
+    }
+
+    [[nodiscard]] PointPtr lowest_absent_element() const
+    {
+        return m_min_absent_ptr;
+    }
+
+    void reset(PointPtr start, PointPtr end)
+    {
+        m_start = start;
+        m_end = end;
+        m_min_absent_ptr = start;
+        m_abnormal_elements.clear();
+    }
+
+    void add(PointPtr element)
+    {
+        if (m_min_absent_ptr == element) {
+            ++m_min_absent_ptr;
+            while (true) {
+                auto next_elem_iter
+                    = std::find(m_abnormal_elements.begin(),
+                                m_abnormal_elements.end(), m_min_absent_ptr);
+                if (next_elem_iter == m_abnormal_elements.end()) {
+                    return;
+                }
+                std::swap(*next_elem_iter, m_abnormal_elements.back());
+                m_abnormal_elements.pop_back();
+                ++m_min_absent_ptr;
+            }
+        } else {
+            m_abnormal_elements.push_back(element);
+        }
+    }
+};
+
+// The order elements are added in. In order is what happens on charts without
+// sustains; the others are what dense sustains lead to.
+enum class AddOrder { InOrder, Interleaved, Reversed };
+
+std::vector<Point> make_points(int count)
+{
+    const SpPosition position {SightRead::Beat {0.0}, SpMeasure {0.0}};
+    return std::vector<Point>(static_cast<std::size_t>(count),
+                              {position, position, position, std::nullopt, 50,
+                               50, false, false, false});
+}
+
+std::vector<int> add_order(int count, AddOrder order)
+{
+    std::vector<int> indices;
+    indices.reserve(static_cast<std::size_t>(count));
+    switch (order) {
+    case AddOrder::InOrder:
+        for (auto i = 0; i < count; ++i) {
+            indices.push_back(i);
+        }
+        break;
+    case AddOrder::Interleaved:
+        for (auto i = 1; i < count; i += 2) {
+            indices.push_back(i);
+        }
+        for (auto i = 0; i < count; i += 2) {
+            indices.push_back(i);
+        }
+        break;
+    case AddOrder::Reversed:
+        for (auto i = count - 1; i >= 0; --i) {
+            indices.push_back(i);
+        }
+        break;
+    }
+    return indices;
+}
+
+template <typename RangeSet>
+std::size_t run_workload(const std::vector<Point>& points,
+                         const std::vector<int>& indices, RangeSet& set)
+{
+    std::size_t checksum = 0;
+    for (auto index : indices) {
+        const auto element = points.cbegin() + index;
+        if (!set.contains(element)) {
+            set.add(element);
+        }
+        checksum += static_cast<std::size_t>(set.lowest_absent_element()
+                                             - points.cbegin());
+    }
+    return checksum;
+}
+
+// Mirrors how complete_subpath uses the set: every element is checked before
+// it is added, and the lowest absent element is read after each add. If
+// reuse_set is set, one set is reset for each repetition, as
+// candidate_subpaths does, rather than a new one being made.
+template <typename RangeSet>
+double time_workload(const std::vector<Point>& points,
+                     const std::vector<int>& indices, int repetitions,
+                     bool reuse_set = false)
+{
+    std::size_t checksum = 0;
+    RangeSet reused_set {points.cbegin(), points.cend()};
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < repetitions; ++i) {
+        if (reuse_set) {
+            reused_set.reset(points.cbegin(), points.cend());
+            checksum += run_workload(points, indices, reused_set);
+        } else {
+            RangeSet set {points.cbegin(), points.cend()};
+            checksum += run_workload(points, indices, set);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if (checksum == 0) {
+        std::puts("Empty workload");
+    }
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+}
+
+int main(int argc, char** argv)
+{
+    constexpr int DEFAULT_POINT_COUNT = 4000;
+    constexpr int REPETITIONS = 20;
+
+    const auto point_count
+        = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_POINT_COUNT;
+    if (point_count < 1) {
+        std::fputs("Point count must be positive\n", stderr);
+        return EXIT_FAILURE;
+    }
+    const auto points = make_points(point_count);
+
+    const std::vector<std::tuple<const char*, AddOrder>> workloads {
+        {"in order", AddOrder::InOrder},
+        {"interleaved", AddOrder::Interleaved},
+        {"reversed", AddOrder::Reversed}};
+    std::printf("%d points, %d repetitions\n", point_count, REPETITIONS);
+    std::printf("%-12s %12s %12s %12s\n", "order", "linear ms", "bitset ms",
+                "reused ms");
+    for (const auto& [name, order] : workloads) {
+        const auto indices = add_order(point_count, order);
+        const auto linear_ms = time_workload<LinearPointPtrRangeSet>(
+            points, indices, REPETITIONS);
+        const auto bitset_ms
+            = time_workload<PointPtrRangeSet>(points, indices, REPETITIONS);
+        const auto reused_ms = time_workload<PointPtrRangeSet>(
+            points, indices, REPETITIONS, true);
+        std::printf("%-12s %12.2f %12.2f %12.2f\n", name, linear_ms,
+                    bitset_ms, reused_ms);
+    }
+    return EXIT_SUCCESS;
+}
@@ -276,8 +276,15 @@ Settings MainWindow::get_settings() const
     settings.engine
         = game_to_engine(settings.game, settings.instrument, precision_mode);
     settings.is_lefty_flip = m_ui->leftyCheckBox->isChecked();
+    settings.early_whammy_follows_squeeze = false;
+    settings.squeeze_sweep = {};
+    settings.optimiser_settings = OptimiserSettings::default_settings();
     settings.opacity
         = static_cast<float>(m_ui->opacitySlider->value() / PERCENTAGE_IN_UNIT);
+    settings.print_stats = false;
+    settings.print_quick_path = true;
+    settings.result_cache_dir = "";
+    settings.checkpoint_dir = "";
 
     const auto lazy_whammy_text = m_ui->lazyWhammyLineEdit->text();
     auto ok = false;
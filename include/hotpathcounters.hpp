@@ -0,0 +1,83 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHOPT_HOTPATHCOUNTERS_HPP
+#define CHOPT_HOTPATHCOUNTERS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Counters for the innermost parts of the search are only compiled in when
+// CHOPT_DETAILED_STATS is defined (the ENABLE_DETAILED_STATS CMake option), so
+// that normal builds do not pay for them. CHOPT_COUNT bumps a StatCounter and
+// CHOPT_TALLY a plain count only touched by one thread; both do nothing
+// otherwise, including not evaluating their argument.
+#ifdef CHOPT_DETAILED_STATS
+#define CHOPT_COUNT(counter) (counter).increment()
+#define CHOPT_TALLY(count) static_cast<void>(++(count))
+#else
+#define CHOPT_COUNT(counter) static_cast<void>(0)
+#define CHOPT_TALLY(count) static_cast<void>(0)
+#endif
+
+// A counter that may be bumped from several threads at once. Copying takes a
+// snapshot of the count.
+class StatCounter {
+private:
+    std::atomic<std::uint64_t> m_count {0};
+
+public:
+    StatCounter() = default;
+    StatCounter(const StatCounter& other)
+        : m_count {other.value()}
+    {
+    }
+    StatCounter& operator=(const StatCounter& other)
+    {
+        m_count = other.value();
+        return *this;
+    }
+    ~StatCounter() = default;
+    StatCounter(StatCounter&& other) noexcept
+        : m_count {other.value()}
+    {
+    }
+    StatCounter& operator=(StatCounter&& other) noexcept
+    {
+        m_count = other.value();
+        return *this;
+    }
+
+    void increment() { m_count.fetch_add(1, std::memory_order_relaxed); }
+    [[nodiscard]] std::uint64_t value() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+};
+
+// The events counted while checking activations and working out their
+// squeeze and timing.
+struct HotPathCounters {
+    StatCounter valid_acts;
+    StatCounter insufficient_sp_acts;
+    StatCounter surplus_sp_acts;
+    StatCounter whammy_queries;
+    StatCounter bisection_steps;
+};
+
+#endif
@@ -33,6 +33,7 @@
 #include "engine.hpp"
 #include "points.hpp"
 #include "processed.hpp"
+#include "resultcache.hpp"
 #include "sp.hpp"
 #include "sptimemap.hpp"
 
@@ -229,6 +230,28 @@ ImageBuilder make_builder(SightRead::Song& song,
                           const SightRead::NoteTrack& track,
                           const Settings& settings,
                           const std::function<void(const char*)>& write,
-                          const std::atomic<bool>* terminate);
+                          const std::atomic<bool>* terminate,
+                          const ResultCache* result_cache = nullptr);
+
+// The path for one squeeze level of a squeeze sweep.
+struct SweepResult {
+    int squeeze_percent;
+    std::size_t activation_count;
+    ImageBuilder builder;
+};
+
+// The squeeze settings for one level of a squeeze sweep, the same as a single
+// run at that squeeze would use.
+SqueezeSettings sweep_level_squeeze_settings(const Settings& settings,
+                                             int squeeze_percent);
+
+// Optimises the track at each squeeze in settings.squeeze_sweep. Everything
+// that does not depend on squeeze is only worked out once, and the levels are
+// optimised in parallel with up to settings.optimiser_settings.threads threads.
+std::vector<SweepResult>
+make_sweep_builders(SightRead::Song& song, const SightRead::NoteTrack& track,
+                    const Settings& settings,
+                    const std::function<void(const char*)>& write,
+                    const std::atomic<bool>* terminate);
 
 #endif
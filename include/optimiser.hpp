@@ -21,17 +21,64 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
 #include <limits>
-#include <map>
+#include <memory_resource>
 #include <optional>
+#include <ostream>
+#include <string>
 #include <tuple>
 #include <vector>
 
 #include <sightread/time.hpp>
 
+#include "pointptrrangeset.hpp"
 #include "points.hpp"
 #include "processed.hpp"
 
+class ThreadPool;
+
+// Counts of the work the optimiser did to find a path.
+struct SearchStats {
+    std::uint64_t song_segments {1};
+    std::uint64_t subproblems_solved {0};
+    std::uint64_t previous_subpaths_reused {0};
+    int warm_start_score_boost {0};
+    std::uint64_t candidates_scored {0};
+    std::uint64_t candidates_pruned {0};
+    std::uint64_t tie_lists_dropped {0};
+    std::uint64_t prefetched_lists_taken {0};
+    std::uint64_t prefetched_lists_evicted {0};
+    std::size_t peak_cache_bytes {0};
+    std::chrono::duration<double> search_time {0.0};
+    std::chrono::duration<double> reconstruction_time {0.0};
+#ifdef CHOPT_DETAILED_STATS
+    std::uint64_t path_cache_hits {0};
+    std::uint64_t path_cache_misses {0};
+    std::uint64_t full_sp_cache_hits {0};
+    std::uint64_t full_sp_cache_misses {0};
+    std::uint64_t valid_acts {0};
+    std::uint64_t insufficient_sp_acts {0};
+    std::uint64_t surplus_sp_acts {0};
+    std::uint64_t whammy_queries {0};
+    std::uint64_t bisection_steps {0};
+    // Activations checked while working out squeezes and timings for the
+    // chosen path, rather than during the search.
+    std::uint64_t reconstruction_acts_checked {0};
+#endif
+};
+
+// Gives a human readable summary of SearchStats.
+std::string stats_summary(const SearchStats& stats);
+
+// Gives the peak memory used by the optimiser's cache, in human readable form.
+std::string cache_memory_summary(const SearchStats& stats);
+
 // The class that stores extra information needed on top of a ProcessedSong for
 // the purposes of optimisation, and finds the optimal path. The song passed to
 // Optimiser's constructor must outlive Optimiser; the class is done this way so
@@ -45,7 +92,7 @@ private:
     // activation at the point key or later, under the condition there is
     // already full SP there.
     struct CacheKey {
-        PointPtr point;
+        PointIndex point;
         SpPosition position {SightRead::Beat(0.0), SpMeasure(0.0)};
 
         friend bool operator<(const CacheKey& lhs, const CacheKey& rhs)
@@ -55,74 +102,152 @@ private:
         }
     };
 
+    // Tie lists in the cache are allocated from an arena that lasts for one
+    // call of optimal_path, rather than each one being allocated separately.
+    using NextActs = std::pmr::vector<std::tuple<ProtoActivation, CacheKey>>;
+
+    // possible_next_acts is dropped to save memory if is_trimmed is set, and
+    // must then be worked out again with rebuild_next_acts. Values taken from
+    // a neighbouring subproblem (is_reused) are never trimmed, since rebuilding
+    // would not necessarily give back the same list.
     struct CacheValue {
-        std::vector<std::tuple<ProtoActivation, CacheKey>> possible_next_acts;
+        NextActs possible_next_acts;
         int score_boost;
+        bool is_reused {false};
+        bool is_trimmed {false};
     };
 
-    struct Cache {
-        std::map<CacheKey, CacheValue> paths;
-        std::map<PointPtr, CacheValue> full_sp_paths;
-    };
+    // Open addressing hash table from CacheKey to CacheValue. The entries are
+    // stored contiguously in insertion order and the table itself only holds
+    // indices into them, so a lookup is a single linear probe over a flat
+    // array. The entries for each point are also indexed in order of beat,
+    // which provides the ordered lookup that try_previous_best_subpaths needs.
+    // Keys are stored and looked up by canonical_key, so keys that only differ
+    // by where they are between two whammy ranges share an entry: the whammy
+    // available from a key is the only thing its position affects in the
+    // search.
+    class PathCache {
+    public:
+        struct Entry {
+            CacheKey key;
+            CacheValue value;
+        };
 
-    // The idea is this is like a std::set<PointPtr>, but is add-only and takes
-    // advantage of the fact that we often tend to add all elements before a
-    // certain point.
-    class PointPtrRangeSet {
     private:
-        PointPtr m_start;
-        PointPtr m_end;
-        PointPtr m_min_absent_ptr;
-        std::vector<PointPtr> m_abnormal_elements;
+        static constexpr std::uint32_t EMPTY_SLOT = 0;
+
+        const SpData* m_sp_data;
+        std::vector<Entry> m_entries;
+        std::vector<std::uint32_t> m_slots;
+        std::vector<std::vector<std::uint32_t>> m_entries_by_point;
+        std::size_t m_memory_usage {0};
+        std::size_t m_next_entry_to_trim {0};
+
+        [[nodiscard]] std::size_t slot_of(CacheKey key) const;
+        void grow();
 
     public:
-        PointPtrRangeSet(PointPtr start, PointPtr end)
-            : m_start {start}
-            , m_end {end}
-            , m_min_absent_ptr {start}
+        PathCache(std::size_t point_count, const SpData& sp_data);
+
+        [[nodiscard]] CacheKey canonical_key(CacheKey key) const
         {
-            assert(start < end); // NOLINT
+            key.position = m_sp_data->whammy_equivalent_position(key.position);
+            return key;
         }
 
-        [[nodiscard]] bool contains(PointPtr element) const
+        [[nodiscard]] const CacheValue* find(CacheKey key) const;
+        const CacheValue& emplace(CacheKey key, CacheValue value);
+        // The entries in the order they were added.
+        [[nodiscard]] const std::vector<Entry>& entries() const
         {
-            if (m_start > element || m_end <= element) {
-                return false;
-            }
-            if (element < m_min_absent_ptr) {
-                return true;
-            }
-            return std::find(m_abnormal_elements.cbegin(),
-                             m_abnormal_elements.cend(), element)
-                != m_abnormal_elements.cend();
+            return m_entries;
         }
-
-        [[nodiscard]] PointPtr lowest_absent_element() const
+        // Returns the entry with the greatest key less than key, provided that
+        // entry is for key.point or the point immediately before it.
+        [[nodiscard]] const Entry* previous_entry(CacheKey key) const;
+        // Returns the entry with the least key greater than key, provided that
+        // entry is for key.point or the point immediately after it.
+        [[nodiscard]] const Entry* next_entry(CacheKey key) const;
+        // The bytes allocated for the table and the values in it.
+        [[nodiscard]] std::size_t memory_usage() const
         {
-            return m_min_absent_ptr;
+            return m_memory_usage;
         }
+        // Drops the tie lists of the oldest entries until at most
+        // target_usage bytes are used or there are none left to drop, and
+        // returns how many were dropped.
+        std::size_t trim_cold_entries(std::size_t target_usage);
+    };
+
+    struct SubpathCandidate {
+        ProtoActivation act;
+        CacheKey next_key;
+        int act_score;
+    };
+
+    // The activations find_best_subpaths chooses between for a key, in the
+    // order it considers them. If full_sp_point is a real point then the paths
+    // that have full SP from that point onwards are considered last.
+    struct SubpathCandidates {
+        std::vector<SubpathCandidate> acts;
+        PointIndex full_sp_point;
+    };
+
+    // A subproblem the iterative engine has started but not yet finished.
+    // next_candidate is the first candidate whose rest of path is not yet
+    // accounted for in best_subpaths.
+    struct SearchFrame {
+        CacheKey key;
+        bool has_full_sp;
+        SubpathCandidates candidates;
+        std::size_t next_candidate;
+        bool has_full_sp_candidates;
+        CacheValue best_subpaths;
+        int score_lower_bound;
+        int highest_pruned_bound;
+    };
+
+    // One activation of the greedy path, taken from key, and the score it and
+    // the rest of the greedy path gain from there.
+    struct GreedyStep {
+        CacheKey key;
+        ProtoActivation act;
+        int rest_of_path_score_boost;
+    };
+
+    class SubpathPrefetcher;
+
+    // Values should only be added through store_path and store_full_sp_path,
+    // which keep track of memory use and keep to the memory limit.
+    struct Cache {
+        PathCache paths;
+        std::vector<std::optional<CacheValue>> full_sp_paths;
+        std::size_t full_sp_memory_usage;
+        std::optional<std::size_t> memory_limit;
+        std::pmr::memory_resource* arena;
+        SubpathPrefetcher* prefetcher = nullptr;
+        SearchStats stats;
+        // The greedy path, whose scores are lower bounds for the search.
+        std::vector<GreedyStep> warm_start;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        bool is_out_of_time = false;
+
+        Cache(const ProcessedSong& song,
+              std::optional<std::size_t> memory_limit,
+              std::pmr::memory_resource* arena);
 
-        void add(PointPtr element)
+        // Includes the candidates the prefetcher has waiting, if there is
+        // one.
+        [[nodiscard]] std::size_t memory_usage() const;
+        // A value with no activations whose tie list uses the arena.
+        [[nodiscard]] CacheValue empty_value() const
         {
-            assert(m_start <= element); // NOLINT
-            assert(element < m_end); // NOLINT
-            if (m_min_absent_ptr == element) {
-                ++m_min_absent_ptr;
-                while (true) {
-                    auto next_elem_iter = std::find(m_abnormal_elements.begin(),
-                                                    m_abnormal_elements.end(),
-                                                    m_min_absent_ptr);
-                    if (next_elem_iter == m_abnormal_elements.end()) {
-                        return;
-                    }
-                    std::swap(*next_elem_iter, m_abnormal_elements.back());
-                    m_abnormal_elements.pop_back();
-                    ++m_min_absent_ptr;
-                }
-            } else {
-                m_abnormal_elements.push_back(element);
-            }
+            return {NextActs {arena}, 0};
         }
+        const CacheValue& store_path(CacheKey key, CacheValue value);
+        const CacheValue& store_full_sp_path(std::size_t index,
+                                             CacheValue value);
+        void keep_to_memory_limit();
     };
 
     static constexpr double NEG_INF = -std::numeric_limits<double>::infinity();
@@ -131,39 +256,115 @@ private:
     const std::atomic<bool>* m_terminate;
     const SightRead::Second m_drum_fill_delay;
     SightRead::Second m_whammy_delay;
-    std::vector<PointPtr> m_next_candidate_points;
+    OptimiserSettings m_settings;
+    std::vector<PointIndex> m_next_candidate_points;
 
-    [[nodiscard]] PointPtr next_candidate_point(PointPtr point) const;
+    [[nodiscard]] PointIndex next_candidate_point(PointIndex point) const;
     [[nodiscard]] CacheKey advance_cache_key(CacheKey key) const;
     [[nodiscard]] CacheKey add_whammy_delay(CacheKey key) const;
+    [[nodiscard]] std::vector<CacheKey> segment_start_keys() const;
+    bool has_run_out_of_time(Cache& cache) const;
+    [[nodiscard]] std::uint64_t checkpoint_fingerprint() const;
+    void write_cache_value(std::ostream& stream,
+                           const CacheValue& value) const;
+    bool read_cache_value(std::istream& stream, CacheValue& value) const;
+    void save_checkpoint(const Cache& cache) const;
+    void load_checkpoint(Cache& cache) const;
+    [[nodiscard]] bool may_reuse_previous_subpaths(CacheKey key,
+                                                   bool has_full_sp) const;
+    [[nodiscard]] NextActs rebuild_next_acts(CacheKey key, int score_boost,
+                                             const Cache& cache) const;
     [[nodiscard]] std::optional<CacheValue>
     try_previous_best_subpaths(CacheKey key, const Cache& cache,
                                bool has_full_sp) const;
     CacheValue find_best_subpaths(CacheKey key, Cache& cache,
                                   bool has_full_sp) const;
     int get_partial_path(CacheKey key, Cache& cache) const;
-    int get_partial_full_sp_path(PointPtr point, Cache& cache) const;
-    [[nodiscard]] double act_squeeze_level(ProtoActivation act,
-                                           CacheKey key) const;
+    const CacheValue& get_partial_full_sp_path(PointIndex point,
+                                               Cache& cache) const;
+    [[nodiscard]] bool is_squeeze_level_valid(ProtoActivation act,
+                                              CacheKey key,
+                                              double sqz_level) const;
+    // Returns the squeeze level needed for the activation. If the activation
+    // cannot do better than level_to_beat, then level_to_beat is returned
+    // instead, which saves checking every level.
+    [[nodiscard]] double act_squeeze_level(ProtoActivation act, CacheKey key,
+                                           double level_to_beat = 1.0) const;
     [[nodiscard]] SpPosition forced_whammy_end(ProtoActivation act,
                                                CacheKey key,
                                                double sqz_level) const;
     [[nodiscard]] std::tuple<SightRead::Beat, SightRead::Beat>
     act_duration(ProtoActivation act, CacheKey key, double sqz_level,
                  SpPosition min_whammy_force) const;
+    [[nodiscard]] Activation make_activation(ProtoActivation act, CacheKey key,
+                                             double sqz_level) const;
+    [[nodiscard]] std::tuple<std::size_t, double>
+    least_squeeze_act(const NextActs& acts, CacheKey key,
+                      ThreadPool* pool) const;
+    [[nodiscard]] CacheKey first_cache_key() const;
+    [[nodiscard]] PointIndex first_full_sp_point(CacheKey key) const;
+    [[nodiscard]] std::vector<GreedyStep> greedy_steps() const;
+    [[nodiscard]] Path
+    path_from_greedy_steps(const std::vector<GreedyStep>& steps) const;
     [[nodiscard]] SightRead::Second
     earliest_fill_appearance(CacheKey key, bool has_full_sp) const;
-    void complete_subpath(
-        PointPtr p, SpPosition starting_pos, SpBar sp_bar,
-        PointPtrRangeSet& attained_act_ends, Cache& cache,
-        int& best_score_boost,
-        std::vector<std::tuple<ProtoActivation, CacheKey>>& acts) const;
+    [[nodiscard]] PointIndex next_activation_point(PointIndex point) const;
+    void complete_subpath(PointIndex p, SpPosition starting_pos, SpBar sp_bar,
+                          PointPtrRangeSet& attained_act_ends,
+                          std::vector<SubpathCandidate>& candidates) const;
+    [[nodiscard]] SubpathCandidates candidate_subpaths(CacheKey key,
+                                                       bool has_full_sp) const;
+    SubpathCandidates take_candidate_subpaths(CacheKey key, bool has_full_sp,
+                                              Cache& cache) const;
+    [[nodiscard]] int path_score_upper_bound(CacheKey key,
+                                             const Cache& cache) const;
+    [[nodiscard]] int path_score_lower_bound(CacheKey key, bool has_full_sp,
+                                             const Cache& cache) const;
+    [[nodiscard]] bool can_prune(const CacheValue& best_subpaths,
+                                 int score_lower_bound,
+                                 const SubpathCandidate& candidate,
+                                 const Cache& cache,
+                                 int& highest_pruned_bound) const;
+    [[nodiscard]] bool can_prune_full_sp(const CacheValue& best_subpaths,
+                                         int score_lower_bound,
+                                         PointIndex full_sp_point,
+                                         int& highest_pruned_bound) const;
+    static void check_pruned_bound(const CacheValue& best_subpaths,
+                                   int highest_pruned_bound,
+                                   const Cache& cache);
+    static void add_subpath(CacheValue& best_subpaths,
+                            const SubpathCandidate& candidate,
+                            int rest_of_path_score_boost, bool keep_ties);
+    static void add_full_sp_subpaths(CacheValue& best_subpaths,
+                                     const CacheValue& full_sp_subpaths,
+                                     bool keep_ties);
+    void open_subproblem(CacheKey key, bool has_full_sp, Cache& cache,
+                         std::vector<SearchFrame>& frames) const;
+    int get_partial_path_iteratively(CacheKey key, Cache& cache) const;
 
 public:
     Optimiser(const ProcessedSong* song, const std::atomic<bool>* terminate,
-              int speed, SightRead::Second whammy_delay);
-    // Return the optimal Star Power path.
-    [[nodiscard]] Path optimal_path() const;
+              int speed, SightRead::Second whammy_delay,
+              const OptimiserSettings& settings
+              = OptimiserSettings::default_settings());
+    // Return the optimal Star Power path. If stats is non-null, it is filled
+    // with counts of the work done to find the path. If the time budget runs
+    // out, the best path found so far is returned instead and marked as
+    // possibly suboptimal; this is the greedy path if the search had not yet
+    // beaten it. The budget includes finding the greedy path, which is always
+    // found in full. If the settings name a checkpoint file, the solved
+    // subproblems are saved to it when the search is cancelled or runs out of
+    // time, and a later run on the same song and settings resumes from them.
+    // If the settings ask for the score only, the path has no activations.
+    // If on_greedy_path is set, it is called with the greedy path as soon as
+    // it has been found, before the search proper.
+    [[nodiscard]] Path optimal_path(
+        SearchStats* stats = nullptr,
+        const std::function<void(const Path&)>& on_greedy_path = {}) const;
+    // Return a path found by always taking the activation worth the most
+    // right away. This is much quicker than optimal_path, and the path is
+    // marked as possibly suboptimal.
+    [[nodiscard]] Path greedy_path() const;
 };
 
 #endif
@@ -0,0 +1,139 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHOPT_POINTPTRRANGESET_HPP
+#define CHOPT_POINTPTRRANGESET_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "points.hpp"
+
+// The idea is this is like a std::set<PointPtr>, but is add-only and takes
+// advantage of the fact that we often tend to add all elements before a
+// certain point. Membership is kept in a bitset over [start, end), so contains
+// and add are constant time, and the lowest absent element is found a word at
+// a time. reset reuses the bitset for another range, so a set can be kept
+// around instead of allocating a new one each time.
+class PointPtrRangeSet {
+private:
+    static constexpr std::size_t WORD_BITS = 64;
+
+    PointPtr m_start;
+    PointPtr m_end;
+    PointPtr m_min_absent_ptr;
+    std::vector<std::uint64_t> m_words;
+    // Every word from here on is zero.
+    std::size_t m_words_used {0};
+
+    [[nodiscard]] static std::size_t word_count(std::size_t size)
+    {
+        return (size + WORD_BITS - 1) / WORD_BITS;
+    }
+
+    [[nodiscard]] std::size_t index_of(PointPtr element) const
+    {
+        return static_cast<std::size_t>(std::distance(m_start, element));
+    }
+
+    [[nodiscard]] bool is_set(std::size_t index) const
+    {
+        return ((m_words[index / WORD_BITS] >> (index % WORD_BITS)) & 1U) != 0;
+    }
+
+    // Moves m_min_absent_ptr past the run of present elements it is on.
+    void skip_present_elements()
+    {
+        const auto size = index_of(m_end);
+        auto index = index_of(m_min_absent_ptr);
+        while (index < size) {
+            const auto offset = index % WORD_BITS;
+            const auto word = m_words[index / WORD_BITS] >> offset;
+            const auto run = static_cast<std::size_t>(std::countr_one(word));
+            index += run;
+            if (run < WORD_BITS - offset) {
+                break;
+            }
+        }
+        m_min_absent_ptr = std::next(m_start, static_cast<std::ptrdiff_t>(
+                                                  std::min(index, size)));
+    }
+
+public:
+    PointPtrRangeSet(PointPtr start, PointPtr end)
+        : m_start {start}
+        , m_end {end}
+        , m_min_absent_ptr {start}
+        , m_words(word_count(index_of(end)), 0)
+    {
+        assert(start < end); // NOLINT
+    }
+
+    // Empties the set and makes it cover [start, end) instead. Only the words
+    // that have been written to are cleared, and the bitset is only
+    // reallocated if the new range needs more words than it has.
+    void reset(PointPtr start, PointPtr end)
+    {
+        assert(start < end); // NOLINT
+        std::fill_n(m_words.begin(), m_words_used, 0);
+        m_words_used = 0;
+        m_start = start;
+        m_end = end;
+        m_min_absent_ptr = start;
+        const auto new_word_count = word_count(index_of(end));
+        if (m_words.size() < new_word_count) {
+            m_words.resize(new_word_count, 0);
+        }
+    }
+
+    [[nodiscard]] bool contains(PointPtr element) const
+    {
+        if (m_start > element || m_end <= element) {
+            return false;
+        }
+        return element < m_min_absent_ptr || is_set(index_of(element));
+    }
+
+    [[nodiscard]] PointPtr lowest_absent_element() const
+    {
+        return m_min_absent_ptr;
+    }
+
+    void add(PointPtr element)
+    {
+        assert(m_start <= element); // NOLINT
+        assert(element < m_end); // NOLINT
+        const auto index = index_of(element);
+        m_words[index / WORD_BITS] |= std::uint64_t {1} << (index % WORD_BITS);
+        m_words_used = std::max(m_words_used, index / WORD_BITS + 1);
+        if (m_min_absent_ptr != element) {
+            return;
+        }
+        ++m_min_absent_ptr;
+        if (m_min_absent_ptr < m_end && is_set(index + 1)) {
+            skip_present_elements();
+        }
+    }
+};
+
+#endif
@@ -19,6 +19,8 @@
 #ifndef CHOPT_POINTS_HPP
 #define CHOPT_POINTS_HPP
 
+#include <cstdint>
+#include <iterator>
 #include <limits>
 #include <optional>
 #include <string>
@@ -49,14 +51,21 @@ struct Point {
 
 using PointPtr = std::vector<Point>::const_iterator;
 
+// The position of a point in its PointSet. This is half the size of a PointPtr
+// and stays valid if the PointSet is copied, so it is what tables of points
+// store.
+using PointIndex = std::uint32_t;
+
 class PointSet {
 private:
     std::vector<Point> m_points;
-    std::vector<PointPtr> m_first_after_current_sp;
-    std::vector<PointPtr> m_next_non_hold_point;
-    std::vector<PointPtr> m_next_sp_granting_note;
+    std::vector<PointIndex> m_first_after_current_sp;
+    std::vector<PointIndex> m_next_non_hold_point;
+    std::vector<PointIndex> m_next_sp_granting_note;
+    std::vector<PointIndex> m_next_fill_point;
     std::vector<std::tuple<SpPosition, int>> m_solo_boosts;
     std::vector<int> m_cumulative_score_totals;
+    std::vector<int> m_cumulative_phrase_counts;
     SightRead::Second m_video_lag;
     std::vector<std::string> m_colours;
 
@@ -68,19 +77,77 @@ public:
              const Engine& engine);
     [[nodiscard]] PointPtr cbegin() const { return m_points.cbegin(); }
     [[nodiscard]] PointPtr cend() const { return m_points.cend(); }
+    // The index one past the last point, corresponding to cend().
+    [[nodiscard]] PointIndex end_index() const
+    {
+        return static_cast<PointIndex>(m_points.size());
+    }
+    [[nodiscard]] PointIndex index_of(PointPtr point) const
+    {
+        return static_cast<PointIndex>(std::distance(m_points.cbegin(), point));
+    }
+    [[nodiscard]] PointPtr ptr_at(PointIndex index) const
+    {
+        return std::next(m_points.cbegin(), index);
+    }
+    [[nodiscard]] const Point& operator[](PointIndex index) const
+    {
+        return m_points[index];
+    }
+    [[nodiscard]] bool is_hold_point(PointIndex point) const
+    {
+        return m_points[point].is_hold_point;
+    }
+    [[nodiscard]] bool is_sp_granting_note(PointIndex point) const
+    {
+        return m_points[point].is_sp_granting_note;
+    }
+    // Returns the first point at or after start whose hit window ends after
+    // measure, or the end index if there is none.
+    [[nodiscard]] PointIndex
+    first_hit_window_end_after(PointIndex start, SpMeasure measure) const;
     // Designed for engines without SP overlap, so the next activation is not
     // using part of the given phrase. If the point is not part of a phrase, or
     // the engine supports overlap, then this just returns the next point.
     [[nodiscard]] PointPtr first_after_current_phrase(PointPtr point) const;
+    [[nodiscard]] PointIndex first_after_current_phrase(PointIndex point) const
+    {
+        return m_first_after_current_sp[point];
+    }
     [[nodiscard]] PointPtr next_non_hold_point(PointPtr point) const;
+    [[nodiscard]] PointIndex next_non_hold_point(PointIndex point) const
+    {
+        return m_next_non_hold_point[point];
+    }
     [[nodiscard]] PointPtr next_sp_granting_note(PointPtr point) const;
+    [[nodiscard]] PointIndex next_sp_granting_note(PointIndex point) const
+    {
+        return m_next_sp_granting_note[point];
+    }
+    // Returns the first point at or after the given one that ends a drum fill,
+    // i.e., that has a fill_start.
+    [[nodiscard]] PointPtr next_fill_point(PointPtr point) const;
+    [[nodiscard]] PointIndex next_fill_point(PointIndex point) const
+    {
+        return m_next_fill_point[point];
+    }
     [[nodiscard]] std::string colour_set(PointPtr point) const
     {
-        return m_colours[static_cast<std::size_t>(
-            std::distance(m_points.cbegin(), point))];
+        return m_colours[index_of(point)];
     }
     // Get the combined score of all points that are >= start and < end.
-    [[nodiscard]] int range_score(PointPtr start, PointPtr end) const;
+    [[nodiscard]] int range_score(PointPtr start, PointPtr end) const
+    {
+        return range_score(index_of(start), index_of(end));
+    }
+    [[nodiscard]] int range_score(PointIndex start, PointIndex end) const
+    {
+        return m_cumulative_score_totals[end]
+            - m_cumulative_score_totals[start];
+    }
+    // Get the number of SP phrases granted by points that are >= start and <
+    // end, with unison bonuses counting as an extra phrase.
+    [[nodiscard]] int range_phrase_count(PointPtr start, PointPtr end) const;
     [[nodiscard]] const std::vector<std::tuple<SpPosition, int>>&
     solo_boosts() const
     {
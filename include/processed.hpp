@@ -19,7 +19,9 @@
 #ifndef CHOPT_PROCESSED_HPP
 #define CHOPT_PROCESSED_HPP
 
+#include <algorithm>
 #include <limits>
+#include <memory>
 #include <numeric>
 #include <string>
 #include <tuple>
@@ -30,6 +32,7 @@
 #include <sightread/tempomap.hpp>
 #include <sightread/time.hpp>
 
+#include "hotpathcounters.hpp"
 #include "points.hpp"
 #include "settings.hpp"
 #include "sp.hpp"
@@ -42,9 +45,11 @@ struct ActivationCandidate {
     SpBar sp_bar {0.0, 0.0};
 };
 
+// The optimiser stores a great many of these, so they hold PointIndex values
+// rather than PointPtrs.
 struct ProtoActivation {
-    PointPtr act_start;
-    PointPtr act_end;
+    PointIndex act_start;
+    PointIndex act_end;
 };
 
 struct Activation {
@@ -70,6 +75,46 @@ struct ActResult {
 struct Path {
     std::vector<Activation> activations;
     int score_boost {0};
+    // Set if the optimiser ran out of time or the path was found greedily, so
+    // a better path may exist.
+    bool is_possibly_suboptimal {false};
+};
+
+// Tracks the SP bar while an activation is in progress, for working out where
+// it can end.
+class SpStatus {
+private:
+    static constexpr double MEASURES_PER_BAR = 8.0;
+
+    SpPosition m_position;
+    double m_sp;
+    bool m_overlap_engine;
+
+public:
+    SpStatus(SpPosition position, double sp, bool overlap_engine)
+        : m_position {position}
+        , m_sp {sp}
+        , m_overlap_engine {overlap_engine}
+    {
+    }
+
+    [[nodiscard]] SpPosition position() const { return m_position; }
+    [[nodiscard]] double sp() const { return m_sp; }
+
+    void add_phrase()
+    {
+        constexpr double SP_PHRASE_AMOUNT = 0.25;
+
+        m_sp += SP_PHRASE_AMOUNT;
+        m_sp = std::min(m_sp, 1.0);
+    }
+
+    void advance_whammy_max(SpPosition end_position, const SpData& sp_data,
+                            bool does_overlap);
+    void update_early_end(SpPosition sp_note_start, const SpData& sp_data,
+                          SpPosition required_whammy_end);
+    void update_late_end(SpPosition sp_note_start, SpPosition sp_note_end,
+                         const SpData& sp_data, bool does_overlap);
 };
 
 // Represents a song processed for Star Power optimisation. The constructor
@@ -81,7 +126,7 @@ private:
 
     SpTimeMap m_time_map;
     PointSet m_points;
-    SpData m_sp_data;
+    std::shared_ptr<const SpData> m_sp_data;
     double m_minimum_sp_to_activate;
     int m_total_bre_boost;
     int m_total_solo_boost;
@@ -89,10 +134,22 @@ private:
     bool m_ignore_average_multiplier;
     bool m_is_drums;
     bool m_overlaps;
+#ifdef CHOPT_DETAILED_STATS
+    mutable HotPathCounters m_hot_path_counters;
+#endif
+
+    friend class ActEndSweep;
 
     SpBar sp_from_phrases(PointPtr begin, PointPtr end) const;
+    // These forward to SpData, counting the calls for --stats.
+    [[nodiscard]] double available_whammy(SightRead::Beat start,
+                                          SightRead::Beat end) const;
+    [[nodiscard]] double available_whammy(SightRead::Beat start,
+                                          SightRead::Beat end,
+                                          SightRead::Beat note_pos) const;
     std::vector<std::string> act_summaries(const Path& path) const;
     std::vector<std::string> drum_act_summaries(const Path& path) const;
+    [[nodiscard]] int no_sp_score() const;
     void append_activation(std::stringstream& stream,
                            const Activation& activation,
                            const std::string& act_summary) const;
@@ -112,6 +169,14 @@ public:
                   const Engine& engine,
                   const std::vector<SightRead::Tick>& od_beats,
                   const std::vector<SightRead::Tick>& unison_phrases);
+    // As above, but using SpData already built for the track with the same
+    // time map, so that songs differing only in squeeze can share it.
+    ProcessedSong(const SightRead::NoteTrack& track, SpTimeMap time_map,
+                  std::shared_ptr<const SpData> sp_data,
+                  const SqueezeSettings& squeeze_settings,
+                  const SightRead::DrumSettings& drum_settings,
+                  const Engine& engine,
+                  const std::vector<SightRead::Tick>& unison_phrases);
 
     // Return the minimum and maximum amount of SP can be acquired between two
     // points. Does not include SP from the point act_start. first_point is
@@ -139,6 +204,8 @@ public:
         SpPosition required_whammy_end = default_position()) const;
     // Return the summary of a path.
     [[nodiscard]] std::string path_summary(const Path& path) const;
+    // Return the no SP and total scores of a path, without the activations.
+    [[nodiscard]] std::string score_summary(const Path& path) const;
 
     // Return the position that is (100 - squeeze)% along the start of point's
     // timing window.
@@ -150,13 +217,59 @@ public:
                                                      double squeeze) const;
 
     [[nodiscard]] const PointSet& points() const { return m_points; }
-    [[nodiscard]] const SpData& sp_data() const { return m_sp_data; }
+    [[nodiscard]] const SpData& sp_data() const { return *m_sp_data; }
     [[nodiscard]] const SpTimeMap& sp_time_map() const { return m_time_map; }
     [[nodiscard]] bool is_drums() const { return m_is_drums; }
     [[nodiscard]] double minimum_sp_to_activate() const
     {
         return m_minimum_sp_to_activate;
     }
+#ifdef CHOPT_DETAILED_STATS
+    [[nodiscard]] HotPathCounters& hot_path_counters() const
+    {
+        return m_hot_path_counters;
+    }
+#endif
+};
+
+// Does the same job as ProcessedSong::is_candidate_valid for activations that
+// share a start, earliest activation point and SP bar, as act ends are tried
+// in increasing order. The SP granting notes that every later act end also
+// goes through are only accounted for once, so trying every act end takes time
+// linear in the length of the activation rather than quadratic.
+class ActEndSweep {
+private:
+    const ProcessedSong* m_song;
+    PointPtr m_act_start;
+    SpPosition m_earliest_activation_point;
+    SpBar m_sp_bar;
+    double m_squeeze;
+    SpPosition m_required_whammy_end;
+    SpPosition m_late_end_start;
+    double m_late_end_sp {0.0};
+    SpStatus m_early_end_status;
+    SpStatus m_late_end_status;
+    PointPtr m_next_sp_note;
+    PointPtr m_commit_act_end;
+    SpPosition m_commit_limit;
+    bool m_can_activate;
+    bool m_is_short_of_sp {false};
+
+    void reset();
+    bool add_sp_note(PointPtr sp_note, SpPosition ending_pos,
+                     SpStatus& early_end_status,
+                     SpStatus& late_end_status) const;
+    ActResult check_act_end(PointPtr act_end);
+    void commit_sp_notes(PointPtr act_end, SpPosition ending_pos);
+
+public:
+    ActEndSweep(const ProcessedSong& song, PointPtr act_start,
+                SpPosition earliest_activation_point, SpBar sp_bar,
+                double squeeze, SpPosition required_whammy_end);
+
+    // Gives the same result as is_candidate_valid for an activation ending at
+    // act_end.
+    ActResult check(PointPtr act_end);
 };
 
 #endif
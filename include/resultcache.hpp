@@ -0,0 +1,60 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHOPT_RESULTCACHE_HPP
+#define CHOPT_RESULTCACHE_HPP
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "points.hpp"
+#include "processed.hpp"
+#include "settings.hpp"
+
+struct CachedResult {
+    Path path;
+    std::string path_summary;
+};
+
+// Returns the key for the result of optimising a song with the given settings.
+// content_hash should be SongFile::content_hash() for the song. Only settings
+// that can change the path or its summary are part of the key.
+std::string result_cache_key(const std::string& content_hash,
+                             const Settings& settings);
+
+// An on-disk store for the optimal path of one song under one set of settings,
+// so that later runs can skip the optimiser. Points are stored by index, so
+// the PointSet passed to load must come from the same song and settings as the
+// one passed to store.
+class ResultCache {
+private:
+    std::filesystem::path m_file_path;
+
+public:
+    ResultCache(const std::filesystem::path& directory, const std::string& key);
+
+    // Returns std::nullopt if there is no usable entry.
+    [[nodiscard]] std::optional<CachedResult>
+    load(const PointSet& points) const;
+    // Failing to write the entry is not an error; the next run just has to
+    // optimise again.
+    void store(const CachedResult& result, const PointSet& points) const;
+};
+
+#endif
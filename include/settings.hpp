@@ -19,9 +19,14 @@
 #ifndef CHOPT_SETTINGS_HPP
 #define CHOPT_SETTINGS_HPP
 
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
+#include <vector>
 
 #include <QStringList>
 
@@ -57,6 +62,37 @@ struct SqueezeSettings {
     }
 };
 
+// How the optimiser works through its dynamic programming subproblems. Both
+// find the same path; Iterative keeps its own stack instead of recursing.
+enum class DpEngine { Recursive, Iterative };
+
+// Options that only affect how the optimiser goes about its search, not the
+// path it finds, unless the time budget runs out or only the score is wanted.
+struct OptimiserSettings {
+    int threads {1};
+    DpEngine dp_engine {DpEngine::Recursive};
+    // If set, the optimiser stops searching once this much time has passed and
+    // returns the best path it has found so far.
+    std::optional<std::chrono::milliseconds> time_budget;
+    // Empty if the search should not be checkpointed.
+    std::filesystem::path checkpoint_file;
+    // If set, the optimiser keeps its cache to roughly this many bytes by
+    // dropping tie lists it can work out again later.
+    std::optional<std::size_t> memory_limit;
+    // If set, the optimiser only finds the best score boost. Ties are not
+    // kept and the path's activations are left empty.
+    bool score_only {false};
+    // Whether candidates that cannot beat the best subpath so far are skipped.
+    // Turning this off is only useful to check the bounds used to prune.
+    bool prune_candidates {true};
+
+    static OptimiserSettings default_settings()
+    {
+        return {1, DpEngine::Recursive, std::nullopt, {}, std::nullopt,
+                false, true};
+    }
+};
+
 // This struct represents the options chosen on the command line by the user.
 struct Settings {
     bool blank;
@@ -69,12 +105,26 @@ struct Settings {
     SightRead::Difficulty difficulty;
     SightRead::Instrument instrument;
     SqueezeSettings squeeze_settings;
+    // True unless early whammy was set on its own, in which case it stays at
+    // squeeze_settings.early_whammy for every level of a squeeze sweep.
+    bool early_whammy_follows_squeeze;
+    // Squeeze percentages to optimise at instead of squeeze_settings.squeeze,
+    // empty unless sweeping.
+    std::vector<int> squeeze_sweep;
+    OptimiserSettings optimiser_settings;
     int speed;
     bool is_lefty_flip;
     Game game;
     std::unique_ptr<Engine> engine;
     SightRead::DrumSettings drum_settings;
     float opacity;
+    bool print_stats;
+    // If set, a quickly found path is printed before the optimal one.
+    bool print_quick_path;
+    // Empty if results should not be cached.
+    std::string result_cache_dir;
+    // Empty if the optimiser should not checkpoint its search.
+    std::string checkpoint_dir;
 };
 
 // Parses the command line options.
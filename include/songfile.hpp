@@ -35,10 +35,17 @@ private:
     std::vector<std::uint8_t> m_loaded_file;
     SightRead::Metadata m_metadata;
     FileType m_file_type;
+    std::string m_content_hash;
 
 public:
     explicit SongFile(const std::string& filename);
     SightRead::Song load_song(Game game) const;
+    // A hash of everything read from disk that the loaded song depends on,
+    // i.e., the song file and its song.ini.
+    [[nodiscard]] const std::string& content_hash() const
+    {
+        return m_content_hash;
+    }
 };
 
 #endif
@@ -135,6 +135,10 @@ public:
                                  SpPosition required_whammy_end) const;
     // Return if a beat is at a place that can be whammied.
     [[nodiscard]] bool is_in_whammy_ranges(SightRead::Beat beat) const;
+    // Return a position that gives the same results as pos for every
+    // available_whammy call starting from it. Positions between the same pair
+    // of whammy ranges all give the start of the later range.
+    [[nodiscard]] SpPosition whammy_equivalent_position(SpPosition pos) const;
     // Return the amount of whammy obtainable across a range.
     [[nodiscard]] double available_whammy(SightRead::Beat start,
                                           SightRead::Beat end) const;
@@ -0,0 +1,130 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHOPT_THREADPOOL_HPP
+#define CHOPT_THREADPOOL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed size pool of threads. Each thread has its own queue of tasks which it
+// takes from the back of, and idle threads steal from the front of other
+// threads' queues. The thread that owns the pool gets a queue of its own and
+// takes part in the work whenever it waits on a TaskGroup.
+class ThreadPool {
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    // Threads waiting on a TaskGroup or help_until sleep on m_progress while
+    // there is nothing for them to run, and are woken when a task is queued
+    // or finishes.
+    std::condition_variable m_progress;
+    std::atomic<int> m_queued_tasks {0};
+    std::atomic<int> m_parked_helpers {0};
+    std::atomic<bool> m_stopping {false};
+
+    // Sleeping threads also wake up after this long, in case what they wait
+    // on is changed by something other than a task of the pool.
+    static constexpr std::chrono::milliseconds IDLE_WAIT {1};
+
+    [[nodiscard]] std::size_t own_queue_index() const;
+    void push(Task task);
+    bool try_run_task(bool allow_stealing);
+    void wake_parked_helpers();
+    void worker_loop(std::size_t index);
+
+    template <typename Predicate>
+    void park_until(Predicate is_done, bool wake_for_queued_tasks)
+    {
+        std::unique_lock lock {m_wake_mutex};
+        ++m_parked_helpers;
+        m_progress.wait_for(lock, IDLE_WAIT, [&] {
+            return is_done() || (wake_for_queued_tasks && m_queued_tasks > 0);
+        });
+        --m_parked_helpers;
+    }
+
+public:
+    // A set of tasks that can be waited on together. Tasks may themselves
+    // create and wait on TaskGroups. An exception thrown by a task is
+    // rethrown by wait.
+    class TaskGroup {
+    private:
+        ThreadPool& m_pool;
+        std::atomic<int> m_pending_tasks {0};
+        std::mutex m_error_mutex;
+        std::exception_ptr m_error;
+
+        void help_until_done();
+
+    public:
+        explicit TaskGroup(ThreadPool& pool)
+            : m_pool {pool}
+        {
+        }
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+        ~TaskGroup();
+
+        void run(std::function<void()> task);
+        void wait();
+    };
+
+    // thread_count includes the thread that creates the pool, so a pool of
+    // size 1 runs every task on the thread that waits on it.
+    explicit ThreadPool(int thread_count);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    [[nodiscard]] int thread_count() const
+    {
+        return static_cast<int>(m_queues.size());
+    }
+
+    // Runs queued tasks on the calling thread until is_done returns true,
+    // sleeping while there are none to run.
+    template <typename Predicate> void help_until(Predicate is_done)
+    {
+        while (!is_done()) {
+            if (!try_run_task(true)) {
+                park_until(is_done, true);
+            }
+        }
+    }
+};
+
+#endif
@@ -16,14 +16,23 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstdint>
+#include <iomanip>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 
 #include "imagebuilder.hpp"
 #include "optimiser.hpp"
+#include "threadpool.hpp"
 
 constexpr int MAX_BEATS_PER_LINE = 16;
+constexpr const char* SUBOPTIMAL_PATH_WARNING
+    = "The time budget ran out, so this path may not be optimal";
 
 namespace {
 double get_beat_rate(const SightRead::TempoMap& tempo_map, SightRead::Beat beat)
@@ -281,6 +290,119 @@ void apply_drum_settings(SightRead::NoteTrack& track,
         track.disable_cymbals();
     }
 }
+
+// The data behind an image that depends on neither the path nor the squeeze,
+// along with a builder that has had everything not depending on them added.
+struct PreparedTrack {
+    SightRead::NoteTrack track;
+    const SightRead::TempoMap& tempo_map;
+    SpTimeMap time_map;
+    std::vector<SightRead::Tick> unison_positions;
+    std::vector<SightRead::Solo> solos;
+    ImageBuilder builder;
+};
+
+PreparedTrack prepare_track(SightRead::Song& song,
+                            const SightRead::NoteTrack& track,
+                            const Settings& settings)
+{
+    auto new_track = track;
+    if (song.global_data().is_from_midi()) {
+        new_track = track.trim_sustains();
+    }
+    new_track = new_track.snap_chords(settings.engine->snap_gap());
+    if (track.track_type() == SightRead::TrackType::Drums) {
+        apply_drum_settings(new_track, song, settings);
+    }
+    song.speedup(settings.speed);
+    const auto& tempo_map = song.global_data().tempo_map();
+    const SpTimeMap time_map {tempo_map, settings.engine->sp_mode()};
+
+    auto builder = build_with_engine_params(new_track, settings);
+    builder.add_song_header(song.global_data());
+    builder.add_practice_sections(song.global_data().practice_sections(),
+                                  tempo_map);
+
+    if (track.track_type() == SightRead::TrackType::Drums) {
+        builder.add_drum_fills(new_track);
+    }
+
+    if (settings.draw_bpms) {
+        builder.add_bpms(tempo_map);
+    }
+
+    auto solos = new_track.solos(settings.drum_settings);
+    if (settings.draw_solos) {
+        builder.add_solo_sections(solos, tempo_map);
+    }
+
+    if (settings.draw_time_sigs) {
+        builder.add_time_sigs(tempo_map);
+    }
+
+    auto unison_positions = (settings.engine->has_unison_bonuses())
+        ? song.unison_phrase_positions()
+        : std::vector<SightRead::Tick> {};
+
+    return {std::move(new_track), tempo_map,          time_map,
+            std::move(unison_positions), std::move(solos), std::move(builder)};
+}
+
+void add_optimised_path(ImageBuilder& builder, const PreparedTrack& prepared,
+                        const ProcessedSong& processed_track, const Path& path,
+                        const Settings& settings)
+{
+    builder.add_sp_phrases(prepared.track, prepared.unison_positions, path);
+    builder.add_sp_acts(processed_track.points(), prepared.tempo_map, path);
+    builder.activation_opacity() = settings.opacity;
+}
+
+void add_path_values(ImageBuilder& builder, const PreparedTrack& prepared,
+                     const ProcessedSong& processed_track, const Path& path,
+                     const Settings& settings)
+{
+    const auto& tempo_map = prepared.tempo_map;
+    builder.add_measure_values(processed_track.points(), tempo_map, path);
+    if (settings.blank || !settings.engine->overlaps()) {
+        builder.add_sp_values(processed_track.sp_data(), *settings.engine);
+    } else {
+        builder.add_sp_percent_values(processed_track.sp_data(),
+                                      prepared.time_map,
+                                      processed_track.points(), path);
+    }
+    builder.set_total_score(processed_track.points(), prepared.solos, path);
+    if (settings.engine->has_bres() && prepared.track.bre().has_value()) {
+        const auto bre = prepared.track.bre();
+        if (bre.has_value()) {
+            builder.add_bre(*bre, tempo_map);
+        }
+    }
+}
+
+bool is_rb_drums(const SightRead::NoteTrack& track, const Settings& settings)
+{
+    return track.track_type() == SightRead::TrackType::Drums
+        && settings.engine->is_rock_band();
+}
+
+std::string sweep_summary(const std::vector<SweepResult>& results)
+{
+    constexpr int PERCENT_WIDTH = 6;
+    constexpr int SCORE_WIDTH = 12;
+    constexpr int ACTS_WIDTH = 12;
+
+    std::stringstream stream;
+    stream << "Squeeze sweep:\n"
+           << "Squeeze  Total score  Activations";
+    for (const auto& result : results) {
+        stream << '\n'
+               << std::setw(PERCENT_WIDTH)
+               << result.squeeze_percent << "%  "
+               << std::setw(SCORE_WIDTH) << result.builder.total_score()
+               << ' ' << std::setw(ACTS_WIDTH) << result.activation_count;
+    }
+    return stream.str();
+}
 }
 
 void ImageBuilder::form_beat_lines(const SightRead::TempoMap& tempo_map)
@@ -685,45 +807,11 @@ ImageBuilder make_builder(SightRead::Song& song,
                           const SightRead::NoteTrack& track,
                           const Settings& settings,
                           const std::function<void(const char*)>& write,
-                          const std::atomic<bool>* terminate)
+                          const std::atomic<bool>* terminate,
+                          const ResultCache* result_cache)
 {
-    auto new_track = track;
-    if (song.global_data().is_from_midi()) {
-        new_track = track.trim_sustains();
-    }
-    new_track = new_track.snap_chords(settings.engine->snap_gap());
-    if (track.track_type() == SightRead::TrackType::Drums) {
-        apply_drum_settings(new_track, song, settings);
-    }
-    song.speedup(settings.speed);
-    const auto& tempo_map = song.global_data().tempo_map();
-    const SpTimeMap time_map {tempo_map, settings.engine->sp_mode()};
-
-    auto builder = build_with_engine_params(new_track, settings);
-    builder.add_song_header(song.global_data());
-    builder.add_practice_sections(song.global_data().practice_sections(),
-                                  tempo_map);
-
-    if (track.track_type() == SightRead::TrackType::Drums) {
-        builder.add_drum_fills(new_track);
-    }
-
-    if (settings.draw_bpms) {
-        builder.add_bpms(tempo_map);
-    }
-
-    const auto solos = new_track.solos(settings.drum_settings);
-    if (settings.draw_solos) {
-        builder.add_solo_sections(solos, tempo_map);
-    }
-
-    if (settings.draw_time_sigs) {
-        builder.add_time_sigs(tempo_map);
-    }
-
-    const auto unison_positions = (settings.engine->has_unison_bonuses())
-        ? song.unison_phrase_positions()
-        : std::vector<SightRead::Tick> {};
+    auto prepared = prepare_track(song, track, settings);
+    auto& builder = prepared.builder;
 
     // The 0.1% squeeze minimum is to get around dumb floating point rounding
     // issues that visibly affect the path at 0% squeeze.
@@ -731,52 +819,207 @@ ImageBuilder make_builder(SightRead::Song& song,
     constexpr double SQUEEZE_EPSILON = 0.001;
     squeeze_settings.squeeze
         = std::max(squeeze_settings.squeeze, SQUEEZE_EPSILON);
-    const ProcessedSong processed_track {new_track,
-                                         time_map,
+    const ProcessedSong processed_track {prepared.track,
+                                         prepared.time_map,
                                          settings.squeeze_settings,
                                          settings.drum_settings,
                                          *settings.engine,
                                          song.global_data().od_beats(),
-                                         unison_positions};
+                                         prepared.unison_positions};
     Path path;
 
     if (!settings.blank) {
-        const auto is_rb_drums
-            = track.track_type() == SightRead::TrackType::Drums
-            && settings.engine->is_rock_band();
-        if (is_rb_drums) {
+        if (is_rb_drums(track, settings)) {
             write("Optimisation disabled for Rock Band drums, planned for a "
                   "future release");
-            builder.add_sp_phrases(new_track, unison_positions, path);
+            builder.add_sp_phrases(prepared.track, prepared.unison_positions,
+                                   path);
         } else {
-            write("Optimising, please wait...");
-            const Optimiser optimiser {&processed_track, terminate,
-                                       settings.speed,
-                                       squeeze_settings.whammy_delay};
-            path = optimiser.optimal_path();
-            write(processed_track.path_summary(path).c_str());
-            builder.add_sp_phrases(new_track, unison_positions, path);
-            builder.add_sp_acts(processed_track.points(), tempo_map, path);
-            builder.activation_opacity() = settings.opacity;
+            const auto cached_result = (result_cache != nullptr)
+                ? result_cache->load(processed_track.points())
+                : std::nullopt;
+            const auto is_score_only = settings.optimiser_settings.score_only;
+            if (cached_result.has_value()) {
+                path = cached_result->path;
+                const auto summary = is_score_only
+                    ? processed_track.score_summary(path)
+                    : cached_result->path_summary;
+                write(summary.c_str());
+            } else {
+                const Optimiser optimiser {&processed_track, terminate,
+                                           settings.speed,
+                                           squeeze_settings.whammy_delay,
+                                           settings.optimiser_settings};
+                // The quick path is the greedy path the search starts from,
+                // so it is written as soon as the search has found it.
+                std::function<void(const Path&)> write_quick_path;
+                if (settings.print_quick_path) {
+                    write_quick_path = [&](const Path& quick_path) {
+                        const auto quick_summary
+                            = "Quick path, may not be optimal:\n"
+                            + processed_track.path_summary(quick_path);
+                        write(quick_summary.c_str());
+                    };
+                }
+                write("Optimising, please wait...");
+                SearchStats stats;
+                path = optimiser.optimal_path(&stats, write_quick_path);
+                const auto path_summary = is_score_only
+                    ? processed_track.score_summary(path)
+                    : processed_track.path_summary(path);
+                write(path_summary.c_str());
+                if (path.is_possibly_suboptimal) {
+                    write(SUBOPTIMAL_PATH_WARNING);
+                }
+                if (settings.print_stats) {
+                    write(stats_summary(stats).c_str());
+                } else if (settings.optimiser_settings.memory_limit
+                               .has_value()) {
+                    write(cache_memory_summary(stats).c_str());
+                }
+                if (result_cache != nullptr && !path.is_possibly_suboptimal
+                    && !is_score_only) {
+                    result_cache->store({path, path_summary},
+                                        processed_track.points());
+                }
+            }
+            if (is_score_only) {
+                return std::move(builder);
+            }
+            add_optimised_path(builder, prepared, processed_track, path,
+                               settings);
         }
     } else {
-        builder.add_sp_phrases(new_track, unison_positions, path);
+        builder.add_sp_phrases(prepared.track, prepared.unison_positions,
+                               path);
     }
 
-    builder.add_measure_values(processed_track.points(), tempo_map, path);
-    if (settings.blank || !settings.engine->overlaps()) {
-        builder.add_sp_values(processed_track.sp_data(), *settings.engine);
-    } else {
-        builder.add_sp_percent_values(processed_track.sp_data(), time_map,
-                                      processed_track.points(), path);
+    add_path_values(builder, prepared, processed_track, path, settings);
+
+    return std::move(builder);
+}
+
+SqueezeSettings sweep_level_squeeze_settings(const Settings& settings,
+                                             int squeeze_percent)
+{
+    auto squeeze_settings = settings.squeeze_settings;
+    squeeze_settings.squeeze = squeeze_percent / 100.0;
+    if (settings.early_whammy_follows_squeeze) {
+        squeeze_settings.early_whammy = squeeze_settings.squeeze;
     }
-    builder.set_total_score(processed_track.points(), solos, path);
-    if (settings.engine->has_bres() && new_track.bre().has_value()) {
-        const auto bre = new_track.bre();
-        if (bre.has_value()) {
-            builder.add_bre(*bre, tempo_map);
+    return squeeze_settings;
+}
+
+std::vector<SweepResult>
+make_sweep_builders(SightRead::Song& song, const SightRead::NoteTrack& track,
+                    const Settings& settings,
+                    const std::function<void(const char*)>& write,
+                    const std::atomic<bool>* terminate)
+{
+    if (settings.blank || is_rb_drums(track, settings)) {
+        throw std::invalid_argument(
+            "Squeeze sweeps need a chart that can be optimised");
+    }
+
+    const auto prepared = prepare_track(song, track, settings);
+    const auto& squeezes = settings.squeeze_sweep;
+
+    // SpData depends on early whammy but not on squeeze, so levels with the
+    // same early whammy share it. Unless early whammy was set on its own, it
+    // follows the squeeze and each level gets its own.
+    std::map<double, std::shared_ptr<const SpData>> sp_data_by_early_whammy;
+    for (auto squeeze : squeezes) {
+        const auto squeeze_settings
+            = sweep_level_squeeze_settings(settings, squeeze);
+        auto& sp_data = sp_data_by_early_whammy[squeeze_settings.early_whammy];
+        if (sp_data == nullptr) {
+            sp_data = std::make_shared<const SpData>(
+                prepared.track, prepared.time_map,
+                song.global_data().od_beats(), squeeze_settings,
+                *settings.engine);
+        }
+    }
+
+    // Levels are optimised in parallel rather than each optimiser getting
+    // threads of its own, since levels share nothing that needs locking.
+    auto level_settings = settings.optimiser_settings;
+    level_settings.threads = 1;
+    const auto thread_count = std::min(settings.optimiser_settings.threads,
+                                       static_cast<int>(squeezes.size()));
+    // The memory limit is for the whole run, so it is shared between the
+    // levels being optimised at once.
+    if (level_settings.memory_limit.has_value()) {
+        *level_settings.memory_limit
+            /= static_cast<std::size_t>(std::max(thread_count, 1));
+    }
+
+    struct LevelOutput {
+        std::string path_summary;
+        bool is_possibly_suboptimal;
+        SearchStats stats;
+        std::optional<SweepResult> result;
+    };
+    std::vector<LevelOutput> outputs(squeezes.size());
+
+    write("Optimising, please wait...");
+    ThreadPool pool {std::max(thread_count, 1)};
+    ThreadPool::TaskGroup group {pool};
+    for (auto i = 0U; i < squeezes.size(); ++i) {
+        group.run([&, i] {
+            const auto squeeze_settings
+                = sweep_level_squeeze_settings(settings, squeezes[i]);
+            const auto& sp_data
+                = sp_data_by_early_whammy.at(squeeze_settings.early_whammy);
+            const ProcessedSong processed_track {prepared.track,
+                                                 prepared.time_map,
+                                                 sp_data,
+                                                 squeeze_settings,
+                                                 settings.drum_settings,
+                                                 *settings.engine,
+                                                 prepared.unison_positions};
+            auto optimiser_settings = level_settings;
+            if (!optimiser_settings.checkpoint_file.empty()) {
+                optimiser_settings.checkpoint_file
+                    += "_sqz" + std::to_string(squeezes[i]);
+            }
+            const Optimiser optimiser {&processed_track, terminate,
+                                       settings.speed,
+                                       squeeze_settings.whammy_delay,
+                                       optimiser_settings};
+            auto& output = outputs[i];
+            const auto path = optimiser.optimal_path(&output.stats);
+            output.path_summary = processed_track.path_summary(path);
+            output.is_possibly_suboptimal = path.is_possibly_suboptimal;
+
+            auto builder = prepared.builder;
+            add_optimised_path(builder, prepared, processed_track, path,
+                               settings);
+            add_path_values(builder, prepared, processed_track, path,
+                            settings);
+            output.result = SweepResult {squeezes[i], path.activations.size(),
+                                         std::move(builder)};
+        });
+    }
+    group.wait();
+
+    std::vector<SweepResult> results;
+    results.reserve(outputs.size());
+    for (auto& output : outputs) {
+        const auto squeeze_header = "Squeeze "
+            + std::to_string(output.result->squeeze_percent) + "%:";
+        write(squeeze_header.c_str());
+        write(output.path_summary.c_str());
+        if (output.is_possibly_suboptimal) {
+            write(SUBOPTIMAL_PATH_WARNING);
+        }
+        if (settings.print_stats) {
+            write(stats_summary(output.stats).c_str());
+        } else if (settings.optimiser_settings.memory_limit.has_value()) {
+            write(cache_memory_summary(output.stats).c_str());
         }
+        results.push_back(std::move(*output.result));
     }
+    write(sweep_summary(results).c_str());
 
-    return builder;
+    return results;
 }
@@ -19,6 +19,9 @@
 #include <atomic>
 #include <cstdio>
 #include <exception>
+#include <filesystem>
+#include <optional>
+#include <string>
 
 #include <QCoreApplication>
 #include <QTextStream>
@@ -27,9 +30,22 @@
 
 #include "image.hpp"
 #include "optimiser.hpp"
+#include "resultcache.hpp"
 #include "settings.hpp"
 #include "songfile.hpp"
 
+namespace {
+std::string sweep_image_path(const std::string& image_path,
+                             int squeeze_percent)
+{
+    std::filesystem::path path {image_path};
+    path.replace_filename(path.stem().string() + "_sqz"
+                          + std::to_string(squeeze_percent)
+                          + path.extension().string());
+    return path.string();
+}
+}
+
 int main(int argc, char** argv)
 {
     QTextStream q_stdout(stdout);
@@ -40,15 +56,43 @@ int main(int argc, char** argv)
         QCoreApplication::setApplicationName("CHOpt");
         QCoreApplication::setApplicationVersion("1.8.1");
 
-        const auto settings = from_args(QCoreApplication::arguments());
+        auto settings = from_args(QCoreApplication::arguments());
         const SongFile song_file {settings.filename};
+        if (!settings.checkpoint_dir.empty()) {
+            std::filesystem::create_directories(settings.checkpoint_dir);
+            settings.optimiser_settings.checkpoint_file
+                = std::filesystem::path {settings.checkpoint_dir}
+                / (result_cache_key(song_file.content_hash(), settings)
+                   + ".checkpoint");
+        }
         auto song = song_file.load_song(settings.game);
         const auto& track
             = song.track(settings.instrument, settings.difficulty);
         const std::atomic<bool> terminate {false};
+        if (!settings.squeeze_sweep.empty()) {
+            const auto results = make_sweep_builders(
+                song, track, settings,
+                [&](auto p) { q_stdout << p << '\n'; }, &terminate);
+            q_stdout.flush();
+            if (settings.draw_image) {
+                for (const auto& result : results) {
+                    const Image image {result.builder};
+                    const auto image_path = sweep_image_path(
+                        settings.image_path, result.squeeze_percent);
+                    image.save(image_path.c_str());
+                }
+            }
+            return EXIT_SUCCESS;
+        }
+        std::optional<ResultCache> result_cache;
+        if (!settings.result_cache_dir.empty()) {
+            result_cache.emplace(
+                settings.result_cache_dir,
+                result_cache_key(song_file.content_hash(), settings));
+        }
         const auto builder = make_builder(
             song, track, settings, [&](auto p) { q_stdout << p << '\n'; },
-            &terminate);
+            &terminate, result_cache ? &*result_cache : nullptr);
         q_stdout.flush();
         if (settings.draw_image) {
             const Image image {builder};
@@ -16,35 +16,712 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
 
 #include "optimiser.hpp"
+#include "threadpool.hpp"
+
+namespace {
+std::uint64_t hash_cache_key(PointIndex point, double beat)
+{
+    constexpr std::uint64_t GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
+    constexpr std::uint64_t FIRST_MULTIPLIER = 0xBF58476D1CE4E5B9ULL;
+    constexpr std::uint64_t SECOND_MULTIPLIER = 0x94D049BB133111EBULL;
+
+    // The map this replaced compared beats with <, so 0.0 and -0.0 must be
+    // the same key.
+    if (beat == 0.0) {
+        beat = 0.0;
+    }
+    auto hash
+        = std::bit_cast<std::uint64_t>(beat) ^ (point * GOLDEN_RATIO);
+    hash ^= hash >> 30;
+    hash *= FIRST_MULTIPLIER;
+    hash ^= hash >> 27;
+    hash *= SECOND_MULTIPLIER;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+bool is_same_key_beat(SightRead::Beat lhs, SightRead::Beat rhs)
+{
+    return !(lhs < rhs) && !(rhs < lhs);
+}
+
+template <typename T, typename Allocator>
+std::size_t capacity_bytes(const std::vector<T, Allocator>& vector)
+{
+    return vector.capacity() * sizeof(T);
+}
+
+// "CHOPTCKP" in ASCII. Bump CHECKPOINT_VERSION whenever the format changes.
+constexpr std::uint64_t CHECKPOINT_MAGIC = 0x504B43544F504843ULL;
+constexpr std::uint32_t CHECKPOINT_VERSION = 2;
+constexpr std::uint8_t REUSED_VALUE_FLAG = 1;
+constexpr std::uint8_t TRIMMED_VALUE_FLAG = 2;
+
+// Below this many activations, handing them out to a thread pool costs more
+// than working through them in turn.
+constexpr std::size_t MIN_PARALLEL_ACTS = 8;
+
+// Calls func on each index in [0, count), split into one contiguous block per
+// thread of the pool.
+template <typename Func>
+void parallel_for(ThreadPool& pool, std::size_t count, Func func)
+{
+    const auto block_count = static_cast<std::size_t>(pool.thread_count());
+    ThreadPool::TaskGroup group {pool};
+    for (auto block = 0U; block < block_count; ++block) {
+        const auto begin = count * block / block_count;
+        const auto end = count * (block + 1) / block_count;
+        group.run([&, begin, end] {
+            for (auto i = begin; i < end; ++i) {
+                func(i);
+            }
+        });
+    }
+    group.wait();
+}
+
+// Checkpoints are written in native byte order, since they are only meant to
+// be read back by the same build of CHOpt.
+template <typename T> void write_raw(std::ostream& stream, T value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), // NOLINT
+                 sizeof(value));
+}
+
+template <typename T> bool read_raw(std::istream& stream, T& value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(value)); // NOLINT
+    return static_cast<bool>(stream);
+}
+
+// The end of the points is only allowed if allow_end is set, which is the case
+// for keys that come after the last activation of a path.
+bool read_point(std::istream& stream, const PointSet& points,
+                PointIndex& point, bool allow_end)
+{
+    if (!read_raw(stream, point)) {
+        return false;
+    }
+    return point < points.end_index()
+        || (point == points.end_index() && allow_end);
+}
+
+void write_position(std::ostream& stream, SpPosition position)
+{
+    write_raw(stream, position.beat.value());
+    write_raw(stream, position.sp_measure.value());
+}
+
+bool read_position(std::istream& stream, SpPosition& position)
+{
+    auto beat = 0.0;
+    auto sp_measure = 0.0;
+    if (!read_raw(stream, beat) || !read_raw(stream, sp_measure)) {
+        return false;
+    }
+    position = {SightRead::Beat {beat}, SpMeasure {sp_measure}};
+    return true;
+}
+
+std::uint64_t fnv1a_hash(std::uint64_t hash, std::uint64_t value)
+{
+    constexpr std::uint64_t FNV_PRIME = 0x100000001B3ULL;
+    constexpr std::uint64_t BYTE_MASK = 0xFF;
+    constexpr int BITS_PER_BYTE = 8;
+
+    for (auto i = 0U; i < sizeof(value); ++i) {
+        hash ^= (value >> (i * BITS_PER_BYTE)) & BYTE_MASK;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+}
+
+std::string stats_summary(const SearchStats& stats)
+{
+    const auto candidates = stats.candidates_scored + stats.candidates_pruned;
+    auto pruned_percent = 0.0;
+    if (candidates != 0) {
+        pruned_percent = 100.0 * static_cast<double>(stats.candidates_pruned)
+            / static_cast<double>(candidates);
+    }
+
+    std::stringstream stream;
+    stream << "Optimiser stats:\n";
+    stream << "  Song segments: " << stats.song_segments << '\n';
+    stream << "  Subproblems solved: " << stats.subproblems_solved << '\n';
+    stream << "  Subproblems reusing previous subpaths: "
+           << stats.previous_subpaths_reused << '\n';
+    stream << "  Greedy warm start score boost: "
+           << stats.warm_start_score_boost << '\n';
+    stream << "  Candidates scored: " << stats.candidates_scored << '\n';
+    stream << "  Candidates pruned: " << stats.candidates_pruned << " ("
+           << std::fixed << std::setprecision(1) << pruned_percent << "%)\n";
+    stream << "  Tie lists dropped: " << stats.tie_lists_dropped << '\n';
+    stream << "  Prefetched candidate lists: " << stats.prefetched_lists_taken
+           << " taken, " << stats.prefetched_lists_evicted << " evicted\n";
+#ifdef CHOPT_DETAILED_STATS
+    stream << "  Path cache lookups: " << stats.path_cache_hits << " hits, "
+           << stats.path_cache_misses << " misses\n";
+    stream << "  Full SP cache lookups: " << stats.full_sp_cache_hits
+           << " hits, " << stats.full_sp_cache_misses << " misses\n";
+    stream << "  Activations checked: " << stats.valid_acts << " valid, "
+           << stats.insufficient_sp_acts << " with too little SP, "
+           << stats.surplus_sp_acts << " with too much SP\n";
+    stream << "  Whammy queries: " << stats.whammy_queries << '\n';
+    stream << "  Bisection steps: " << stats.bisection_steps << '\n';
+    stream << "  Activations checked in path reconstruction: "
+           << stats.reconstruction_acts_checked << '\n';
+#endif
+    stream << "  Search time: " << std::setprecision(3)
+           << stats.search_time.count() << " s\n";
+    stream << "  Path reconstruction time: "
+           << stats.reconstruction_time.count() << " s\n";
+    stream << "  " << cache_memory_summary(stats);
+    return stream.str();
+}
+
+std::string cache_memory_summary(const SearchStats& stats)
+{
+    constexpr double BYTES_PER_MEGABYTE = 1024.0 * 1024.0;
+
+    std::stringstream stream;
+    stream << "Peak cache memory: " << std::fixed << std::setprecision(1)
+           << static_cast<double>(stats.peak_cache_bytes) / BYTES_PER_MEGABYTE
+           << " MB";
+    return stream.str();
+}
+
+Optimiser::PathCache::PathCache(std::size_t point_count, const SpData& sp_data)
+    : m_sp_data {&sp_data}
+    , m_entries_by_point(point_count)
+{
+    constexpr std::size_t INITIAL_SLOT_COUNT = 64;
+
+    m_slots.resize(INITIAL_SLOT_COUNT, EMPTY_SLOT);
+    m_memory_usage
+        = capacity_bytes(m_slots) + capacity_bytes(m_entries_by_point);
+}
+
+std::size_t Optimiser::PathCache::slot_of(CacheKey key) const
+{
+    const auto mask = m_slots.size() - 1;
+    auto slot = static_cast<std::size_t>(
+                    hash_cache_key(key.point, key.position.beat.value()))
+        & mask;
+    while (m_slots[slot] != EMPTY_SLOT) {
+        const auto& entry_key = m_entries[m_slots[slot] - 1].key;
+        if (entry_key.point == key.point
+            && is_same_key_beat(entry_key.position.beat, key.position.beat)) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void Optimiser::PathCache::grow()
+{
+    std::vector<std::uint32_t> old_slots(m_slots.size() * 2, EMPTY_SLOT);
+    std::swap(m_slots, old_slots);
+    m_memory_usage += capacity_bytes(m_slots) - capacity_bytes(old_slots);
+    for (auto index : old_slots) {
+        if (index != EMPTY_SLOT) {
+            m_slots[slot_of(m_entries[index - 1].key)] = index;
+        }
+    }
+}
+
+const Optimiser::CacheValue* Optimiser::PathCache::find(CacheKey key) const
+{
+    const auto index = m_slots[slot_of(canonical_key(key))];
+    if (index == EMPTY_SLOT) {
+        return nullptr;
+    }
+    return &m_entries[index - 1].value;
+}
+
+const Optimiser::CacheValue& Optimiser::PathCache::emplace(CacheKey key,
+                                                           CacheValue value)
+{
+    // We keep the load factor at most a half so probe sequences stay short.
+    if (2 * (m_entries.size() + 1) > m_slots.size()) {
+        grow();
+    }
+    key = canonical_key(key);
+    const auto slot = slot_of(key);
+    if (m_slots[slot] != EMPTY_SLOT) {
+        return m_entries[m_slots[slot] - 1].value;
+    }
+    const auto old_entries_bytes = capacity_bytes(m_entries);
+    m_entries.push_back({key, std::move(value)});
+    const auto index = static_cast<std::uint32_t>(m_entries.size());
+    m_slots[slot] = index;
+    m_memory_usage += capacity_bytes(m_entries) - old_entries_bytes
+        + capacity_bytes(m_entries.back().value.possible_next_acts);
+
+    auto& point_entries = m_entries_by_point[key.point];
+    const auto old_point_entries_bytes = capacity_bytes(point_entries);
+    const auto insert_pos = std::upper_bound(
+        point_entries.begin(), point_entries.end(), key.position.beat,
+        [&](auto beat, auto entry_index) {
+            return beat < m_entries[entry_index - 1].key.position.beat;
+        });
+    point_entries.insert(insert_pos, index);
+    m_memory_usage += capacity_bytes(point_entries) - old_point_entries_bytes;
+    return m_entries.back().value;
+}
+
+const Optimiser::PathCache::Entry*
+Optimiser::PathCache::previous_entry(CacheKey key) const
+{
+    key = canonical_key(key);
+    const auto index = key.point;
+    const auto& point_entries = m_entries_by_point[index];
+    const auto next_entry = std::lower_bound(
+        point_entries.cbegin(), point_entries.cend(), key.position.beat,
+        [&](auto entry_index, auto beat) {
+            return m_entries[entry_index - 1].key.position.beat < beat;
+        });
+    if (next_entry != point_entries.cbegin()) {
+        return &m_entries[*std::prev(next_entry) - 1];
+    }
+    if (index == 0 || m_entries_by_point[index - 1].empty()) {
+        return nullptr;
+    }
+    return &m_entries[m_entries_by_point[index - 1].back() - 1];
+}
+
+const Optimiser::PathCache::Entry*
+Optimiser::PathCache::next_entry(CacheKey key) const
+{
+    key = canonical_key(key);
+    const auto index = key.point;
+    const auto& point_entries = m_entries_by_point[index];
+    const auto next_entry = std::upper_bound(
+        point_entries.cbegin(), point_entries.cend(), key.position.beat,
+        [&](auto beat, auto entry_index) {
+            return beat < m_entries[entry_index - 1].key.position.beat;
+        });
+    if (next_entry != point_entries.cend()) {
+        return &m_entries[*next_entry - 1];
+    }
+    if (index + 1 == m_entries_by_point.size()
+        || m_entries_by_point[index + 1].empty()) {
+        return nullptr;
+    }
+    return &m_entries[m_entries_by_point[index + 1].front() - 1];
+}
+
+// Entries are trimmed in the order they were added. The tie lists of the
+// oldest entries are the least likely to be needed again, since
+// try_previous_best_subpaths looks at entries soon after they are added and
+// only the entries on the optimal path are looked at afterwards.
+std::size_t Optimiser::PathCache::trim_cold_entries(std::size_t target_usage)
+{
+    std::size_t trimmed_count = 0;
+    while (m_memory_usage > target_usage
+           && m_next_entry_to_trim < m_entries.size()) {
+        auto& value = m_entries[m_next_entry_to_trim].value;
+        ++m_next_entry_to_trim;
+        if (value.is_reused || value.possible_next_acts.capacity() == 0) {
+            continue;
+        }
+        m_memory_usage -= capacity_bytes(value.possible_next_acts);
+        value.possible_next_acts.clear();
+        value.possible_next_acts.shrink_to_fit();
+        value.is_trimmed = true;
+        ++trimmed_count;
+    }
+    return trimmed_count;
+}
+
+Optimiser::Cache::Cache(const ProcessedSong& song,
+                        std::optional<std::size_t> memory_limit,
+                        std::pmr::memory_resource* arena)
+    : paths {song.points().end_index(), song.sp_data()}
+    , full_sp_paths(song.points().end_index())
+    , full_sp_memory_usage {capacity_bytes(full_sp_paths)}
+    , memory_limit {memory_limit}
+    , arena {arena}
+{
+}
+
+const Optimiser::CacheValue& Optimiser::Cache::store_path(CacheKey key,
+                                                          CacheValue value)
+{
+    const auto& stored_value = paths.emplace(key, std::move(value));
+    keep_to_memory_limit();
+    return stored_value;
+}
+
+const Optimiser::CacheValue&
+Optimiser::Cache::store_full_sp_path(std::size_t index, CacheValue value)
+{
+    auto& stored_value = full_sp_paths[index];
+    if (stored_value.has_value()) {
+        full_sp_memory_usage
+            -= capacity_bytes(stored_value->possible_next_acts);
+    }
+    stored_value = std::move(value);
+    full_sp_memory_usage += capacity_bytes(stored_value->possible_next_acts);
+    keep_to_memory_limit();
+    return *stored_value;
+}
+
+// Only the tie lists in paths can be dropped, so everything else in the cache,
+// and the candidates the prefetcher has waiting, has to come out of the limit
+// first.
+void Optimiser::Cache::keep_to_memory_limit()
+{
+    const auto usage = memory_usage();
+    stats.peak_cache_bytes = std::max(stats.peak_cache_bytes, usage);
+    if (!memory_limit.has_value() || usage <= *memory_limit) {
+        return;
+    }
+    const auto other_usage = usage - paths.memory_usage();
+    const auto paths_limit
+        = *memory_limit - std::min(*memory_limit, other_usage);
+    stats.tie_lists_dropped += paths.trim_cold_entries(paths_limit);
+}
+
+// Works out the candidate subpaths of keys on a thread pool ahead of the
+// search. The search itself stays serial and fills the cache in exactly the
+// same order as it does without the prefetcher, so the path found does not
+// depend on the number of threads. The prefetcher does not know which keys the
+// search will prune, so it stops running ahead once too many candidate lists
+// are waiting to be taken. Lists the search has gone past without taking are
+// evicted to make room, and the search works those keys out itself if it
+// does come back for them.
+class Optimiser::SubpathPrefetcher {
+private:
+    enum class SlotState { Queued, Running, Ready, Taken };
+
+    struct RequestKey {
+        PointIndex point;
+        double beat;
+        bool has_full_sp;
+
+        bool operator==(const RequestKey&) const = default;
+    };
+
+    struct RequestKeyHash {
+        std::size_t operator()(const RequestKey& key) const
+        {
+            return static_cast<std::size_t>(
+                hash_cache_key(key.point, key.beat)
+                ^ static_cast<std::uint64_t>(key.has_full_sp));
+        }
+    };
+
+    struct Slot {
+        std::atomic<SlotState> state {SlotState::Queued};
+        SubpathCandidates candidates;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<RequestKey, std::shared_ptr<Slot>, RequestKeyHash>
+            slots;
+    };
+
+    struct WaitingSlot {
+        std::shared_ptr<Slot> slot;
+        std::size_t bytes;
+        // The number of keys the search had taken when the slot was filled.
+        std::uint64_t filled_at_take;
+    };
+
+    static constexpr std::size_t SHARD_COUNT = 64;
+    static constexpr std::size_t MAX_WAITING_SLOTS = 4096;
+    // With a memory limit, the waiting candidates may use at most this
+    // fraction of it.
+    static constexpr std::size_t MEMORY_LIMIT_DIVISOR = 4;
+    // A waiting slot is taken to be behind the search once the search has
+    // taken this many other keys since it was filled.
+    static constexpr std::uint64_t STALE_AFTER_TAKES = 256;
+
+    const Optimiser& m_optimiser;
+    ThreadPool& m_pool;
+    std::array<Shard, SHARD_COUNT> m_shards;
+    std::optional<std::size_t> m_waiting_bytes_limit;
+    // The slots filled ahead of the search that it has not yet taken, oldest
+    // first. Slots that have since been taken are dropped lazily, so only the
+    // counts are exact.
+    std::mutex m_waiting_mutex;
+    std::deque<WaitingSlot> m_waiting;
+    std::atomic<std::size_t> m_waiting_slots {0};
+    std::atomic<std::size_t> m_waiting_bytes {0};
+    std::atomic<std::uint64_t> m_takes {0};
+    std::atomic<std::uint64_t> m_prefetched_takes {0};
+    std::atomic<std::uint64_t> m_evictions {0};
+    std::atomic<bool> m_stopping {false};
+    // Declared last so that outstanding tasks finish before anything they use
+    // is destroyed.
+    ThreadPool::TaskGroup m_tasks {m_pool};
+
+    // Keys the cache treats as the same subproblem have the same candidates,
+    // so they share a request too.
+    [[nodiscard]] RequestKey request_key(CacheKey key, bool has_full_sp) const
+    {
+        const auto& song = *m_optimiser.m_song;
+        auto beat = song.sp_data()
+                        .whammy_equivalent_position(key.position)
+                        .beat.value();
+        // -0.0 and 0.0 are the same key as far as the cache is concerned.
+        if (beat == 0.0) {
+            beat = 0.0;
+        }
+        return {key.point, beat, has_full_sp};
+    }
+
+    // Returns the slot for a key, and whether it was created by this call.
+    std::tuple<std::shared_ptr<Slot>, bool> claim(CacheKey key,
+                                                  bool has_full_sp)
+    {
+        const auto request = request_key(key, has_full_sp);
+        auto& shard = m_shards[RequestKeyHash {}(request) % SHARD_COUNT];
+        std::lock_guard lock {shard.mutex};
+        auto& slot = shard.slots[request];
+        if (slot != nullptr) {
+            return {slot, false};
+        }
+        slot = std::make_shared<Slot>();
+        return {slot, true};
+    }
+
+    static bool try_start(Slot& slot)
+    {
+        auto expected = SlotState::Queued;
+        return slot.state.compare_exchange_strong(expected, SlotState::Running);
+    }
+
+    [[nodiscard]] bool is_too_far_ahead() const
+    {
+        return m_waiting_slots >= MAX_WAITING_SLOTS
+            || (m_waiting_bytes_limit.has_value()
+                && m_waiting_bytes >= *m_waiting_bytes_limit);
+    }
+
+    // Hands the oldest waiting slots back to the search until the prefetcher
+    // is within its limits, as long as the search has gone past them.
+    void evict_stale_slots()
+    {
+        std::lock_guard lock {m_waiting_mutex};
+        while (!m_waiting.empty() && is_too_far_ahead()) {
+            auto& oldest = m_waiting.front();
+            const auto state = oldest.slot->state.load();
+            // A slot joins m_waiting just before it is marked ready.
+            if (state == SlotState::Running
+                || (state == SlotState::Ready
+                    && m_takes - oldest.filled_at_take < STALE_AFTER_TAKES)) {
+                return;
+            }
+            // Running keeps take waiting until the slot is Queued again, at
+            // which point it works the candidates out itself.
+            auto expected = SlotState::Ready;
+            if (oldest.slot->state.compare_exchange_strong(
+                    expected, SlotState::Running)) {
+                oldest.slot->candidates = {};
+                --m_waiting_slots;
+                m_waiting_bytes -= oldest.bytes;
+                ++m_evictions;
+                oldest.slot->state = SlotState::Queued;
+            }
+            m_waiting.pop_front();
+        }
+    }
+
+    // is_ahead_of_search is false when the search fills the slot itself in
+    // take, in which case the candidates are taken straight away.
+    void fill(CacheKey key, bool has_full_sp,
+              const std::shared_ptr<Slot>& shared_slot,
+              bool is_ahead_of_search)
+    {
+        auto& slot = *shared_slot;
+        slot.candidates = m_optimiser.candidate_subpaths(key, has_full_sp);
+        // The children have to be queued before the slot is marked ready,
+        // since the search may take the candidates as soon as it is.
+        for (const auto& candidate : slot.candidates.acts) {
+            prefetch(candidate.next_key, false);
+        }
+        const auto& points = m_optimiser.m_song->points();
+        const auto full_sp_point = slot.candidates.full_sp_point;
+        if (full_sp_point != points.end_index()) {
+            const CacheKey full_sp_key {
+                full_sp_point, points[full_sp_point - 1].hit_window_start};
+            prefetch(full_sp_key, true);
+        }
+        if (is_ahead_of_search) {
+            const auto bytes = capacity_bytes(slot.candidates.acts);
+            std::lock_guard lock {m_waiting_mutex};
+            while (!m_waiting.empty()
+                   && m_waiting.front().slot->state == SlotState::Taken) {
+                m_waiting.pop_front();
+            }
+            m_waiting.push_back({shared_slot, bytes, m_takes});
+            ++m_waiting_slots;
+            m_waiting_bytes += bytes;
+        }
+        slot.state = SlotState::Ready;
+    }
+
+public:
+    // Queues key to have its candidates worked out, and then those of the keys
+    // it leads to.
+    void prefetch(CacheKey key, bool has_full_sp)
+    {
+        if (m_stopping
+            || key.point == m_optimiser.m_song->points().end_index()) {
+            return;
+        }
+        if (is_too_far_ahead()) {
+            evict_stale_slots();
+            if (is_too_far_ahead()) {
+                return;
+            }
+        }
+        // These keys are usually settled by try_previous_best_subpaths, so
+        // working out their candidates ahead of time is likely to be wasted.
+        if (m_optimiser.may_reuse_previous_subpaths(key, has_full_sp)) {
+            return;
+        }
+        auto [slot, is_new] = claim(key, has_full_sp);
+        if (!is_new) {
+            return;
+        }
+        m_tasks.run([this, key, has_full_sp, slot = std::move(slot)] {
+            if (m_stopping || m_optimiser.m_terminate->load()
+                || !try_start(*slot)) {
+                return;
+            }
+            try {
+                fill(key, has_full_sp, slot, true);
+            } catch (...) {
+                // Hand the key back so the search can work it out itself.
+                slot->state = SlotState::Queued;
+                throw;
+            }
+        });
+    }
+
+    SubpathPrefetcher(const Optimiser& optimiser, ThreadPool& pool,
+                      std::optional<std::size_t> memory_limit)
+        : m_optimiser {optimiser}
+        , m_pool {pool}
+    {
+        if (memory_limit.has_value()) {
+            m_waiting_bytes_limit = *memory_limit / MEMORY_LIMIT_DIVISOR;
+        }
+    }
+
+    SubpathPrefetcher(const SubpathPrefetcher&) = delete;
+    SubpathPrefetcher& operator=(const SubpathPrefetcher&) = delete;
+
+    ~SubpathPrefetcher() { m_stopping = true; }
+
+    // Stops queueing work and waits for what is already queued, rethrowing
+    // the first exception thrown by a prefetch.
+    void finish()
+    {
+        m_stopping = true;
+        m_tasks.wait();
+    }
+
+    // The bytes used by candidate lists that are waiting to be taken.
+    [[nodiscard]] std::size_t waiting_bytes() const { return m_waiting_bytes; }
+
+    void add_stats(SearchStats& stats) const
+    {
+        stats.prefetched_lists_taken += m_prefetched_takes;
+        stats.prefetched_lists_evicted += m_evictions;
+    }
+
+    SubpathCandidates take(CacheKey key, bool has_full_sp)
+    {
+        ++m_takes;
+        const auto slot = std::get<0>(claim(key, has_full_sp));
+        while (!try_start(*slot)) {
+            m_pool.help_until([&] {
+                return slot->state != SlotState::Running
+                    || m_optimiser.m_terminate->load();
+            });
+            // The search never asks for the same key twice, so the slot is
+            // only kept to stop the key being prefetched again.
+            auto expected = SlotState::Ready;
+            if (slot->state.compare_exchange_strong(expected,
+                                                    SlotState::Taken)) {
+                --m_waiting_slots;
+                m_waiting_bytes -= capacity_bytes(slot->candidates.acts);
+                ++m_prefetched_takes;
+                return std::exchange(slot->candidates, {});
+            }
+            if (m_optimiser.m_terminate->load()) {
+                throw std::runtime_error("Thread halted");
+            }
+        }
+        fill(key, has_full_sp, slot, false);
+        slot->state = SlotState::Taken;
+        return std::exchange(slot->candidates, {});
+    }
+};
+
+std::size_t Optimiser::Cache::memory_usage() const
+{
+    auto usage = paths.memory_usage() + full_sp_memory_usage;
+    if (prefetcher != nullptr) {
+        usage += prefetcher->waiting_bytes();
+    }
+    return usage;
+}
 
 Optimiser::Optimiser(const ProcessedSong* song,
                      const std::atomic<bool>* terminate, int speed,
-                     SightRead::Second whammy_delay)
+                     SightRead::Second whammy_delay,
+                     const OptimiserSettings& settings)
     : m_song {song}
     , m_terminate {terminate}
     , m_drum_fill_delay {BASE_DRUM_FILL_DELAY / speed}
     , m_whammy_delay {whammy_delay}
+    , m_settings {settings}
 {
     if (m_song == nullptr || m_terminate == nullptr) {
         throw std::invalid_argument(
             "Optimiser ctor's arguments must be non-null");
     }
+    if (m_settings.threads < 1) {
+        throw std::invalid_argument("Optimiser must use at least 1 thread");
+    }
     const auto& points = m_song->points();
     const auto& sp_data = m_song->sp_data();
 
-    const auto capacity = std::distance(points.cbegin(), points.cend()) + 1;
-    m_next_candidate_points.reserve(static_cast<std::size_t>(capacity));
+    m_next_candidate_points.reserve(points.end_index() + 1);
     int count = 0;
-    for (auto p = points.cbegin(); p < points.cend(); ++p) {
+    for (PointIndex p = 0; p < points.end_index(); ++p) {
         ++count;
-        if (p->is_sp_granting_note
-            || (p->is_hold_point
-                && sp_data.is_in_whammy_ranges(p->position.beat))) {
+        if (points.is_sp_granting_note(p)
+            || (points.is_hold_point(p)
+                && sp_data.is_in_whammy_ranges(points[p].position.beat))) {
             for (int i = 0; i < count; ++i) {
                 m_next_candidate_points.push_back(p);
             }
@@ -54,26 +731,26 @@ Optimiser::Optimiser(const ProcessedSong* song,
 
     ++count;
     for (int i = 0; i < count; ++i) {
-        m_next_candidate_points.push_back(points.cend());
+        m_next_candidate_points.push_back(points.end_index());
     }
 }
 
-PointPtr Optimiser::next_candidate_point(PointPtr point) const
+PointIndex Optimiser::next_candidate_point(PointIndex point) const
 {
-    const auto index = std::distance(m_song->points().cbegin(), point);
-    return m_next_candidate_points[static_cast<std::size_t>(index)];
+    return m_next_candidate_points[point];
 }
 
 Optimiser::CacheKey Optimiser::advance_cache_key(CacheKey key) const
 {
+    const auto& points = m_song->points();
     key.point = next_candidate_point(key.point);
-    if (key.point == m_song->points().cend()) {
+    if (key.point == points.end_index()) {
         return key;
     }
     key = add_whammy_delay(key);
-    auto pos = key.point->hit_window_start;
-    if (key.point != m_song->points().cbegin()) {
-        pos = std::prev(key.point)->hit_window_start;
+    auto pos = points[key.point].hit_window_start;
+    if (key.point != 0) {
+        pos = points[key.point - 1].hit_window_start;
     }
     if (pos.beat >= key.position.beat) {
         key.position = pos;
@@ -91,34 +768,342 @@ Optimiser::CacheKey Optimiser::add_whammy_delay(CacheKey key) const
     return key;
 }
 
+// A gap between candidate points is long enough to split the song at if a bar
+// of SP drains completely during it. Any activation running at the start of
+// the gap has then ended before the next candidate point, so the rest of the
+// song is commonly reached through that point's earliest key. Saved SP can
+// still be carried over the gap, so the segments are not fully independent,
+// but they can be solved from the end of the song backwards so each one finds
+// what it needs of the later segments already in the cache.
+std::vector<Optimiser::CacheKey> Optimiser::segment_start_keys() const
+{
+    constexpr double MEASURES_PER_BAR = 8.0;
+
+    const auto& points = m_song->points();
+    std::vector<CacheKey> keys;
+    auto p = next_candidate_point(0);
+    while (p != points.end_index()) {
+        const auto next = next_candidate_point(p + 1);
+        if (next == points.end_index()) {
+            break;
+        }
+        const auto gap = points[next].hit_window_start.sp_measure.value()
+            - points[p].hit_window_end.sp_measure.value();
+        if (gap >= MEASURES_PER_BAR) {
+            keys.push_back({next, points[next - 1].hit_window_start});
+        }
+        p = next;
+    }
+    return keys;
+}
+
+Optimiser::CacheKey Optimiser::first_cache_key() const
+{
+    const CacheKey key {0, {SightRead::Beat(NEG_INF), SpMeasure(NEG_INF)}};
+    return advance_cache_key(key);
+}
+
+// Returns the first point straight after an SP granting note by which SP is
+// full, or the end index if there is none.
+PointIndex Optimiser::first_full_sp_point(CacheKey key) const
+{
+    const auto& points = m_song->points();
+    auto note = points.next_sp_granting_note(key.point);
+    while (note + 1 < points.end_index()) {
+        const auto p = note + 1;
+        const auto sp_bar
+            = std::get<0>(m_song->total_available_sp_with_earliest_pos(
+                key.position.beat, points.ptr_at(key.point), points.ptr_at(p),
+                points[note].hit_window_start));
+        if (sp_bar.min() == 1.0) {
+            return p;
+        }
+        note = points.next_sp_granting_note(p);
+    }
+    return points.end_index();
+}
+
+// Waits until SP is full and then takes the activation worth the most straight
+// away, which is quick since only activations before the next SP granting note
+// are looked at. If SP is never full the activations from key are used.
+std::vector<Optimiser::GreedyStep> Optimiser::greedy_steps() const
+{
+    const auto& points = m_song->points();
+    std::vector<GreedyStep> steps;
+    auto key = first_cache_key();
+    while (key.point != points.end_index()) {
+        if (m_terminate->load()) {
+            throw std::runtime_error("Thread halted");
+        }
+        const auto full_sp_point = first_full_sp_point(key);
+        auto candidates = (full_sp_point != points.end_index())
+            ? candidate_subpaths(
+                  {full_sp_point, points[full_sp_point - 1].hit_window_start},
+                  true)
+            : candidate_subpaths(key, false);
+        if (candidates.acts.empty() && full_sp_point != points.end_index()) {
+            candidates = candidate_subpaths(key, false);
+        }
+        const auto best_candidate = std::max_element(
+            candidates.acts.cbegin(), candidates.acts.cend(),
+            [](const auto& lhs, const auto& rhs) {
+                return lhs.act_score < rhs.act_score;
+            });
+        if (best_candidate == candidates.acts.cend()) {
+            break;
+        }
+        steps.push_back({key, best_candidate->act, best_candidate->act_score});
+        key = best_candidate->next_key;
+    }
+
+    auto rest_of_path_score_boost = 0;
+    for (auto step = steps.rbegin(); step != steps.rend(); ++step) {
+        rest_of_path_score_boost += step->rest_of_path_score_boost;
+        step->rest_of_path_score_boost = rest_of_path_score_boost;
+    }
+    return steps;
+}
+
+// Once the time budget has run out, subproblems that are not yet solved are
+// given no further activations. That is always a valid path, so the search
+// winds down quickly with the best path it had found so far.
+bool Optimiser::has_run_out_of_time(Cache& cache) const
+{
+    if (!cache.is_out_of_time && cache.deadline.has_value()
+        && std::chrono::steady_clock::now() >= *cache.deadline) {
+        // Everything solved up to now is exact, which stops being true from
+        // here on, so this is the last chance to checkpoint it.
+        save_checkpoint(cache);
+        cache.is_out_of_time = true;
+    }
+    return cache.is_out_of_time;
+}
+
+// Identifies the song and settings a checkpoint is for, so that one made for a
+// different chart or settings is not used by mistake.
+std::uint64_t Optimiser::checkpoint_fingerprint() const
+{
+    constexpr std::uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+
+    const auto& points = m_song->points();
+    auto hash = FNV_OFFSET_BASIS;
+    for (PointIndex i = 0; i < points.end_index(); ++i) {
+        const auto p = points.ptr_at(i);
+        const auto next_candidate_index = next_candidate_point(i);
+        hash = fnv1a_hash(
+            hash, std::bit_cast<std::uint64_t>(p->position.beat.value()));
+        hash = fnv1a_hash(hash,
+                          std::bit_cast<std::uint64_t>(
+                              p->hit_window_start.beat.value()));
+        hash = fnv1a_hash(
+            hash, std::bit_cast<std::uint64_t>(p->hit_window_end.beat.value()));
+        hash = fnv1a_hash(hash, static_cast<std::uint64_t>(p->value));
+        hash = fnv1a_hash(hash,
+                          static_cast<std::uint64_t>(next_candidate_index));
+    }
+    hash = fnv1a_hash(hash,
+                      std::bit_cast<std::uint64_t>(m_whammy_delay.value()));
+    hash = fnv1a_hash(hash,
+                      std::bit_cast<std::uint64_t>(m_drum_fill_delay.value()));
+    hash = fnv1a_hash(hash, static_cast<std::uint64_t>(m_settings.score_only));
+    return hash;
+}
+
+void Optimiser::write_cache_value(std::ostream& stream,
+                                  const CacheValue& value) const
+{
+    std::uint8_t flags = 0;
+    if (value.is_reused) {
+        flags |= REUSED_VALUE_FLAG;
+    }
+    if (value.is_trimmed) {
+        flags |= TRIMMED_VALUE_FLAG;
+    }
+    write_raw(stream, flags);
+    write_raw(stream, static_cast<std::int32_t>(value.score_boost));
+    write_raw(stream,
+              static_cast<std::uint32_t>(value.possible_next_acts.size()));
+    for (const auto& [act, next_key] : value.possible_next_acts) {
+        write_raw(stream, act.act_start);
+        write_raw(stream, act.act_end);
+        write_raw(stream, next_key.point);
+        write_position(stream, next_key.position);
+    }
+}
+
+bool Optimiser::read_cache_value(std::istream& stream, CacheValue& value) const
+{
+    const auto& points = m_song->points();
+    std::uint8_t flags = 0;
+    std::int32_t score_boost = 0;
+    std::uint32_t act_count = 0;
+    if (!read_raw(stream, flags) || !read_raw(stream, score_boost)
+        || !read_raw(stream, act_count)) {
+        return false;
+    }
+    value.score_boost = score_boost;
+    value.is_reused = (flags & REUSED_VALUE_FLAG) != 0;
+    value.is_trimmed = (flags & TRIMMED_VALUE_FLAG) != 0;
+    for (auto i = 0U; i < act_count; ++i) {
+        ProtoActivation act {};
+        CacheKey next_key;
+        if (!read_point(stream, points, act.act_start, false)
+            || !read_point(stream, points, act.act_end, false)
+            || !read_point(stream, points, next_key.point, true)
+            || !read_position(stream, next_key.position)) {
+            return false;
+        }
+        value.possible_next_acts.emplace_back(act, next_key);
+    }
+    return true;
+}
+
+// The checkpoint is written to a temporary file first, so being interrupted
+// part way through never leaves a truncated checkpoint behind. Failing to
+// write it is not an error; the next run just has to start from scratch.
+void Optimiser::save_checkpoint(const Cache& cache) const
+{
+    const auto& file_path = m_settings.checkpoint_file;
+    if (file_path.empty()) {
+        return;
+    }
+    auto temp_path = file_path;
+    temp_path += ".tmp";
+
+    std::ofstream stream {temp_path, std::ios::binary | std::ios::trunc};
+    write_raw(stream, CHECKPOINT_MAGIC);
+    write_raw(stream, CHECKPOINT_VERSION);
+    write_raw(stream, checkpoint_fingerprint());
+    const auto& entries = cache.paths.entries();
+    write_raw(stream, static_cast<std::uint32_t>(entries.size()));
+    for (const auto& entry : entries) {
+        write_raw(stream, entry.key.point);
+        write_position(stream, entry.key.position);
+        write_cache_value(stream, entry.value);
+    }
+    const auto full_sp_path_count
+        = std::count_if(cache.full_sp_paths.cbegin(),
+                        cache.full_sp_paths.cend(),
+                        [](const auto& path) { return path.has_value(); });
+    write_raw(stream, static_cast<std::uint32_t>(full_sp_path_count));
+    for (auto i = 0U; i < cache.full_sp_paths.size(); ++i) {
+        if (cache.full_sp_paths[i].has_value()) {
+            write_raw(stream, static_cast<std::uint32_t>(i));
+            write_cache_value(stream, *cache.full_sp_paths[i]);
+        }
+    }
+    stream.close();
+
+    std::error_code error;
+    if (!stream) {
+        std::filesystem::remove(temp_path, error);
+        return;
+    }
+    std::filesystem::rename(temp_path, file_path, error);
+}
+
+// A checkpoint that cannot be read, or that is for a different song or
+// settings, is ignored and the search starts from scratch.
+void Optimiser::load_checkpoint(Cache& cache) const
+{
+    const auto& file_path = m_settings.checkpoint_file;
+    if (file_path.empty()) {
+        return;
+    }
+    std::ifstream stream {file_path, std::ios::binary};
+    std::uint64_t magic = 0;
+    std::uint32_t version = 0;
+    std::uint64_t fingerprint = 0;
+    if (!read_raw(stream, magic) || !read_raw(stream, version)
+        || !read_raw(stream, fingerprint) || magic != CHECKPOINT_MAGIC
+        || version != CHECKPOINT_VERSION
+        || fingerprint != checkpoint_fingerprint()) {
+        return;
+    }
+
+    const auto& points = m_song->points();
+    Cache loaded_cache {*m_song, m_settings.memory_limit, cache.arena};
+    std::uint32_t entry_count = 0;
+    if (!read_raw(stream, entry_count)) {
+        return;
+    }
+    for (auto i = 0U; i < entry_count; ++i) {
+        CacheKey key;
+        auto value = loaded_cache.empty_value();
+        if (!read_point(stream, points, key.point, false)
+            || !read_position(stream, key.position)
+            || !read_cache_value(stream, value)) {
+            return;
+        }
+        loaded_cache.store_path(key, std::move(value));
+    }
+    std::uint32_t full_sp_path_count = 0;
+    if (!read_raw(stream, full_sp_path_count)) {
+        return;
+    }
+    for (auto i = 0U; i < full_sp_path_count; ++i) {
+        std::uint32_t index = 0;
+        auto value = loaded_cache.empty_value();
+        if (!read_raw(stream, index)
+            || index >= loaded_cache.full_sp_paths.size()
+            || !read_cache_value(stream, value)) {
+            return;
+        }
+        loaded_cache.store_full_sp_path(index, std::move(value));
+    }
+
+    cache = std::move(loaded_cache);
+}
+
 int Optimiser::get_partial_path(CacheKey key, Cache& cache) const
 {
-    if (key.point == m_song->points().cend()) {
+    if (key.point == m_song->points().end_index()) {
         return 0;
     }
-    if (cache.paths.find(key) == cache.paths.end()) {
+    const auto* cached_path = cache.paths.find(key);
+    if (cached_path == nullptr) {
+        CHOPT_TALLY(cache.stats.path_cache_misses);
         if (m_terminate->load()) {
             throw std::runtime_error("Thread halted");
         }
+        if (has_run_out_of_time(cache)) {
+            return cache.store_path(key, cache.empty_value()).score_boost;
+        }
         auto best_path = find_best_subpaths(key, cache, false);
-        cache.paths.emplace(key, best_path);
-        return best_path.score_boost;
+        return cache.store_path(key, std::move(best_path)).score_boost;
     }
-    return cache.paths.at(key).score_boost;
+    CHOPT_TALLY(cache.stats.path_cache_hits);
+    return cached_path->score_boost;
 }
 
-int Optimiser::get_partial_full_sp_path(PointPtr point, Cache& cache) const
+const Optimiser::CacheValue&
+Optimiser::get_partial_full_sp_path(PointIndex point, Cache& cache) const
 {
-    if (cache.full_sp_paths.find(point) != cache.full_sp_paths.end()) {
-        return cache.full_sp_paths.at(point).score_boost;
+    const auto& cached_path = cache.full_sp_paths[point];
+    if (cached_path.has_value()) {
+        CHOPT_TALLY(cache.stats.full_sp_cache_hits);
+        return *cached_path;
+    }
+    CHOPT_TALLY(cache.stats.full_sp_cache_misses);
+    if (has_run_out_of_time(cache)) {
+        return cache.store_full_sp_path(point, cache.empty_value());
     }
 
     // We only call this from find_best_subpath in a situaiton where we know
-    // point is not m_points.cend(), so we may assume point is a real Point.
-    CacheKey key {point, std::prev(point)->hit_window_start};
-    auto best_path = find_best_subpaths(key, cache, true);
-    cache.full_sp_paths.emplace(point, best_path);
-    return best_path.score_boost;
+    // point is not the end index, so we may assume point is a real Point.
+    CacheKey key {point, m_song->points()[point - 1].hit_window_start};
+    return cache.store_full_sp_path(point,
+                                    find_best_subpaths(key, cache, true));
+}
+
+bool Optimiser::may_reuse_previous_subpaths(CacheKey key,
+                                            bool has_full_sp) const
+{
+    const auto& points = m_song->points();
+    if (has_full_sp || !points.is_hold_point(key.point)) {
+        return false;
+    }
+    return key.point == 0 || points.is_hold_point(key.point - 1);
 }
 
 // This function is an optimisation for the case where key.point is a tick in
@@ -130,31 +1115,30 @@ std::optional<Optimiser::CacheValue>
 Optimiser::try_previous_best_subpaths(CacheKey key, const Cache& cache,
                                       bool has_full_sp) const
 {
-    if (has_full_sp || !key.point->is_hold_point) {
-        return std::nullopt;
-    }
-    if (key.point != m_song->points().cbegin()
-        && !std::prev(key.point)->is_hold_point) {
+    if (!may_reuse_previous_subpaths(key, has_full_sp)) {
         return std::nullopt;
     }
 
-    auto prev_key_iter = cache.paths.lower_bound(key);
-    if (prev_key_iter == cache.paths.begin()) {
+    const auto* prev_entry = cache.paths.previous_entry(key);
+    if (prev_entry == nullptr) {
         return std::nullopt;
     }
 
-    prev_key_iter = std::prev(prev_key_iter);
-    if (std::distance(prev_key_iter->first.point, key.point) > 1) {
-        return std::nullopt;
+    NextActs rebuilt_acts;
+    const auto* acts = &prev_entry->value.possible_next_acts;
+    if (prev_entry->value.is_trimmed) {
+        rebuilt_acts = rebuild_next_acts(
+            prev_entry->key, prev_entry->value.score_boost, cache);
+        acts = &rebuilt_acts;
     }
-
-    const auto& acts = prev_key_iter->second.possible_next_acts;
-    std::vector<std::tuple<ProtoActivation, CacheKey>> next_acts;
-    for (const auto& act : acts) {
-        auto [p, q] = std::get<0>(act);
+    const auto& points = m_song->points();
+    NextActs next_acts {cache.arena};
+    for (const auto& act : *acts) {
+        const auto p = points.ptr_at(std::get<0>(act).act_start);
+        const auto q = points.ptr_at(std::get<0>(act).act_end);
         const auto& [sp_bar, starting_pos]
             = m_song->total_available_sp_with_earliest_pos(
-                key.position.beat, key.point, p,
+                key.position.beat, points.ptr_at(key.point), p,
                 std::prev(p)->hit_window_start);
         ActivationCandidate candidate {p, q, starting_pos, sp_bar};
         auto candidate_result = m_song->is_candidate_valid(candidate);
@@ -168,37 +1152,78 @@ Optimiser::try_previous_best_subpaths(CacheKey key, const Cache& cache,
         return std::nullopt;
     }
 
-    const auto score_boost = prev_key_iter->second.score_boost;
-    return {{next_acts, score_boost}};
+    const auto score_boost = prev_entry->value.score_boost;
+    return {{std::move(next_acts), score_boost, true}};
 }
 
-// This function takes some information and completes the optimal subpaths from
-// it.
+// Works out the possible_next_acts of a trimmed cache entry again. Trimmed
+// entries were found by find_best_subpaths, which scored every candidate that
+// could tie, so the rest of each of those paths is still in the cache. A
+// candidate whose rest of path is not in the cache was pruned, so cannot tie.
+Optimiser::NextActs
+Optimiser::rebuild_next_acts(CacheKey key, int score_boost,
+                             const Cache& cache) const
+{
+    const auto& points = m_song->points();
+    const auto candidates = candidate_subpaths(key, false);
+    NextActs next_acts;
+    for (const auto& candidate : candidates.acts) {
+        auto rest_of_path_score_boost = 0;
+        if (candidate.next_key.point != points.end_index()) {
+            const auto* rest_of_path = cache.paths.find(candidate.next_key);
+            if (rest_of_path == nullptr) {
+                continue;
+            }
+            rest_of_path_score_boost = rest_of_path->score_boost;
+        }
+        if (candidate.act_score + rest_of_path_score_boost == score_boost) {
+            next_acts.emplace_back(candidate.act, candidate.next_key);
+        }
+    }
+    const auto full_sp_point = candidates.full_sp_point;
+    if (full_sp_point != points.end_index()) {
+        const auto& full_sp_path = cache.full_sp_paths[full_sp_point];
+        if (full_sp_path.has_value()
+            && full_sp_path->score_boost == score_boost) {
+            const auto& full_sp_acts = full_sp_path->possible_next_acts;
+            next_acts.insert(next_acts.end(), full_sp_acts.cbegin(),
+                             full_sp_acts.cend());
+        }
+    }
+    return next_acts;
+}
+
+// This function takes some information and adds the activations starting at p
+// that the optimal subpaths could begin with.
 void Optimiser::complete_subpath(
-    PointPtr p, SpPosition starting_pos, SpBar sp_bar,
-    PointPtrRangeSet& attained_act_ends, Cache& cache, int& best_score_boost,
-    std::vector<std::tuple<ProtoActivation, CacheKey>>& acts) const
+    PointIndex p, SpPosition starting_pos, SpBar sp_bar,
+    PointPtrRangeSet& attained_act_ends,
+    std::vector<SubpathCandidate>& candidates) const
 {
+    const SpPosition no_whammy_end {SightRead::Beat {NEG_INF},
+                                    SpMeasure {NEG_INF}};
+    const auto& points = m_song->points();
+    ActEndSweep act_end_sweep {
+        *m_song, points.ptr_at(p), starting_pos, sp_bar, 1.0, no_whammy_end};
     for (auto q = attained_act_ends.lowest_absent_element();
-         q < m_song->points().cend();) {
+         q < points.cend();) {
         if (attained_act_ends.contains(q)) {
             ++q;
             continue;
         }
 
-        ActivationCandidate candidate {p, q, starting_pos, sp_bar};
-        const auto candidate_result = m_song->is_candidate_valid(candidate);
+        const auto candidate_result = act_end_sweep.check(q);
         if (candidate_result.validity != ActValidity::insufficient_sp) {
             attained_act_ends.add(q);
-        } else if (!q->is_hold_point) {
+        } else if (!points.is_hold_point(points.index_of(q))) {
             // We cannot hit any later points if q is not a hold point, so
             // we are done.
-            q = m_song->points().cend();
+            q = points.cend();
             continue;
         } else {
             // We cannot hit any subsequent hold point, so go straight to
             // the next non-hold point.
-            q = m_song->points().next_non_hold_point(q);
+            q = points.next_non_hold_point(q);
             continue;
         }
 
@@ -207,19 +1232,12 @@ void Optimiser::complete_subpath(
             continue;
         }
 
-        const auto act_score = m_song->points().range_score(p, std::next(q));
-        CacheKey next_key {m_song->points().first_after_current_phrase(q),
+        const auto q_index = points.index_of(q);
+        const auto act_score = points.range_score(p, q_index + 1);
+        CacheKey next_key {points.first_after_current_phrase(q_index),
                            candidate_result.ending_position};
         next_key = advance_cache_key(next_key);
-        const auto rest_of_path_score_boost = get_partial_path(next_key, cache);
-        const auto score = act_score + rest_of_path_score_boost;
-        if (score > best_score_boost) {
-            best_score_boost = score;
-            acts.clear();
-            acts.push_back({{p, q}, next_key});
-        } else if (score == best_score_boost) {
-            acts.push_back({{p, q}, next_key});
-        }
+        candidates.push_back({{p, q_index}, next_key, act_score});
         ++q;
     }
 }
@@ -231,52 +1249,69 @@ SightRead::Second Optimiser::earliest_fill_appearance(CacheKey key,
         return SightRead::Second(0.0);
     }
 
-    int sp_count = 0;
-    for (auto p = key.point; p < m_song->points().cend(); ++p) {
-        if (p->is_sp_granting_note) {
-            ++sp_count;
-            if (sp_count == 2) {
-                return m_song->sp_time_map().to_seconds(
-                           p->hit_window_start.beat)
-                    + m_drum_fill_delay;
-            }
-        }
+    const auto& points = m_song->points();
+    const auto first_sp_note = points.next_sp_granting_note(key.point);
+    if (first_sp_note + 1 >= points.end_index()) {
+        return SightRead::Second(0.0);
     }
-
-    return SightRead::Second(0.0);
+    const auto second_sp_note
+        = points.next_sp_granting_note(first_sp_note + 1);
+    if (second_sp_note == points.end_index()) {
+        return SightRead::Second(0.0);
+    }
+    return m_song->sp_time_map().to_seconds(
+               points[second_sp_note].hit_window_start.beat)
+        + m_drum_fill_delay;
 }
 
-Optimiser::CacheValue Optimiser::find_best_subpaths(CacheKey key, Cache& cache,
-                                                    bool has_full_sp) const
+// On drums only the points that end a fill can be activated on, so those are
+// the only ones candidate_subpaths needs to look at.
+PointIndex Optimiser::next_activation_point(PointIndex point) const
 {
-    const auto subpath_from_prev
-        = try_previous_best_subpaths(key, cache, has_full_sp);
-    if (subpath_from_prev) {
-        return *subpath_from_prev;
+    const auto& points = m_song->points();
+    if (!m_song->is_drums() || point == points.end_index()) {
+        return point;
     }
+    return points.next_fill_point(point);
+}
 
+// Finds the activations the best subpaths from key could start with. This does
+// not touch the cache, so it can be run ahead of time on another thread.
+Optimiser::SubpathCandidates
+Optimiser::candidate_subpaths(CacheKey key, bool has_full_sp) const
+{
+    const auto& points = m_song->points();
     const auto early_act_bound = earliest_fill_appearance(key, has_full_sp);
-    std::vector<std::tuple<ProtoActivation, CacheKey>> acts;
-    PointPtrRangeSet attained_act_ends {key.point, m_song->points().cend()};
+    SubpathCandidates candidates {{}, points.end_index()};
+    // The set is kept between calls so its bitset is allocated once per
+    // thread, not twice per subproblem. Prefetching calls this from several
+    // threads at once, so it cannot be shared between them.
+    thread_local std::optional<PointPtrRangeSet> attained_act_ends;
+    if (attained_act_ends.has_value()) {
+        attained_act_ends->reset(points.ptr_at(key.point), points.cend());
+    } else {
+        attained_act_ends.emplace(points.ptr_at(key.point), points.cend());
+    }
     auto lower_bound_set = false;
-    auto best_score_boost = 0;
 
-    for (auto p = key.point; p < m_song->points().cend(); ++p) {
-        if (m_song->is_drums()
-            && (!p->fill_start.has_value()
-                || p->fill_start < early_act_bound)) {
+    for (auto index = next_activation_point(key.point);
+         index < points.end_index();
+         index = next_activation_point(index + 1)) {
+        const auto p = points.ptr_at(index);
+        if (m_song->is_drums() && p->fill_start < early_act_bound) {
             continue;
         }
         SpBar sp_bar {1.0, 1.0};
         SpPosition starting_pos {SightRead::Beat {NEG_INF},
                                  SpMeasure {NEG_INF}};
-        if (p != m_song->points().cbegin()) {
+        if (index != 0) {
             starting_pos = std::prev(p)->hit_window_start;
         }
         if (!has_full_sp) {
             const auto& [new_sp, new_pos]
                 = m_song->total_available_sp_with_earliest_pos(
-                    key.position.beat, key.point, p, starting_pos);
+                    key.position.beat, points.ptr_at(key.point), p,
+                    starting_pos);
             sp_bar = new_sp;
             starting_pos = new_pos;
         }
@@ -289,17 +1324,9 @@ Optimiser::CacheValue Optimiser::find_best_subpaths(CacheKey key, Cache& cache,
         if (!sp_bar.full_enough_to_activate(m_song->minimum_sp_to_activate())) {
             continue;
         }
-        if (p != key.point && sp_bar.min() == 1.0
-            && std::prev(p)->is_sp_granting_note) {
-            get_partial_full_sp_path(p, cache);
-            auto cache_value = cache.full_sp_paths.at(p);
-            if (cache_value.score_boost > best_score_boost) {
-                return cache_value;
-            }
-            if (cache_value.score_boost == best_score_boost) {
-                const auto& next_acts = cache_value.possible_next_acts;
-                acts.insert(acts.end(), next_acts.cbegin(), next_acts.cend());
-            }
+        if (index != key.point && sp_bar.min() == 1.0
+            && points.is_sp_granting_note(index - 1)) {
+            candidates.full_sp_point = index;
             break;
         }
         // This skips some points that are too early to be an act end for the
@@ -308,90 +1335,566 @@ Optimiser::CacheValue Optimiser::find_best_subpaths(CacheKey key, Cache& cache,
             const SpMeasure act_length {
                 8.0 * std::max(sp_bar.min(), m_song->minimum_sp_to_activate())};
             const auto earliest_act_end = starting_pos.sp_measure + act_length;
-            auto earliest_pt_end = std::find_if_not(
-                std::next(p), m_song->points().cend(), [&](const auto& pt) {
-                    return pt.hit_window_end.sp_measure <= earliest_act_end;
-                });
-            --earliest_pt_end;
-            attained_act_ends
-                = PointPtrRangeSet {earliest_pt_end, m_song->points().cend()};
+            const auto earliest_pt_end
+                = points.first_hit_window_end_after(index + 1, earliest_act_end)
+                - 1;
+            attained_act_ends->reset(points.ptr_at(earliest_pt_end),
+                                     points.cend());
             lower_bound_set = true;
         }
-        complete_subpath(p, starting_pos, sp_bar, attained_act_ends, cache,
-                         best_score_boost, acts);
+        complete_subpath(index, starting_pos, sp_bar, *attained_act_ends,
+                         candidates.acts);
+    }
+
+    return candidates;
+}
+
+Optimiser::CacheValue Optimiser::find_best_subpaths(CacheKey key, Cache& cache,
+                                                    bool has_full_sp) const
+{
+    const auto subpath_from_prev
+        = try_previous_best_subpaths(key, cache, has_full_sp);
+    if (subpath_from_prev) {
+        ++cache.stats.previous_subpaths_reused;
+        return std::move(*subpath_from_prev);
+    }
+
+    ++cache.stats.subproblems_solved;
+    const auto score_lower_bound
+        = path_score_lower_bound(key, has_full_sp, cache);
+    const auto candidates = take_candidate_subpaths(key, has_full_sp, cache);
+    auto best_subpaths = cache.empty_value();
+    auto highest_pruned_bound = std::numeric_limits<int>::min();
+    for (const auto& candidate : candidates.acts) {
+        if (can_prune(best_subpaths, score_lower_bound, candidate, cache,
+                      highest_pruned_bound)) {
+            ++cache.stats.candidates_pruned;
+            continue;
+        }
+        ++cache.stats.candidates_scored;
+        add_subpath(best_subpaths, candidate,
+                    get_partial_path(candidate.next_key, cache),
+                    !m_settings.score_only);
+    }
+    const auto full_sp_point = candidates.full_sp_point;
+    if (full_sp_point != m_song->points().end_index()) {
+        if (can_prune_full_sp(best_subpaths, score_lower_bound,
+                              full_sp_point, highest_pruned_bound)) {
+            ++cache.stats.candidates_pruned;
+        } else {
+            ++cache.stats.candidates_scored;
+            const auto& full_sp_subpaths
+                = get_partial_full_sp_path(full_sp_point, cache);
+            add_full_sp_subpaths(best_subpaths, full_sp_subpaths,
+                                 !m_settings.score_only);
+        }
+    }
+    check_pruned_bound(best_subpaths, highest_pruned_bound, cache);
+
+    return best_subpaths;
+}
+
+// An upper bound on get_partial_path(key). No path can gain more than the score
+// of every point that is left. Also, moving a key later can only take options
+// away, so no path can do better than that from an earlier key in the cache.
+// An earlier key at the previous point is only used between two sustain ticks,
+// the case try_previous_best_subpaths relies on as well.
+int Optimiser::path_score_upper_bound(CacheKey key, const Cache& cache) const
+{
+    const auto& points = m_song->points();
+    if (key.point == points.end_index()) {
+        return 0;
+    }
+    auto upper_bound = points.range_score(key.point, points.end_index());
+    const auto* prev_entry = cache.paths.previous_entry(key);
+    if (prev_entry != nullptr
+        && (prev_entry->key.point == key.point
+            || may_reuse_previous_subpaths(key, false))
+        && !(cache.paths.canonical_key(key).position.beat
+             < prev_entry->key.position.beat)) {
+        upper_bound = std::min(upper_bound, prev_entry->value.score_boost);
+    }
+    return upper_bound;
+}
+
+// A lower bound on get_partial_path(key), the other side of
+// path_score_upper_bound: a later key at the same point cannot do better than
+// key, so its score can be reached from key. A key at the next point is only
+// used between two sustain ticks, as in path_score_upper_bound. Past any other
+// point it can do better, since key also has that point's SP to bank, and
+// more SP can stretch an activation over SP notes a later one needed.
+int Optimiser::path_score_lower_bound(CacheKey key, bool has_full_sp,
+                                      const Cache& cache) const
+{
+    if (has_full_sp || key.point == m_song->points().end_index()) {
+        return 0;
+    }
+    const auto key_beat = cache.paths.canonical_key(key).position.beat;
+    auto lower_bound = 0;
+    const auto* next_entry = cache.paths.next_entry(key);
+    if (next_entry != nullptr
+        && (next_entry->key.point == key.point
+            || may_reuse_previous_subpaths(next_entry->key, false))
+        && !(next_entry->key.position.beat < key_beat)) {
+        lower_bound = next_entry->value.score_boost;
+    }
+    // The greedy path's keys are in order of point, and it has at most one
+    // key for each point.
+    const auto& warm_start = cache.warm_start;
+    const auto step = std::lower_bound(
+        warm_start.cbegin(), warm_start.cend(), key.point,
+        [](const auto& s, auto point) { return s.key.point < point; });
+    if (step != warm_start.cend() && step->key.point == key.point
+        && !(cache.paths.canonical_key(step->key).position.beat < key_beat)) {
+        lower_bound = std::max(lower_bound, step->rest_of_path_score_boost);
+    }
+    return lower_bound;
+}
+
+// A candidate that cannot reach the best subpath so far, or the lower bound on
+// the score, need not be looked at any further. Ties are kept, since they are
+// still needed to choose between equal paths. The bound of each candidate
+// pruned is kept in highest_pruned_bound for check_pruned_bound.
+bool Optimiser::can_prune(const CacheValue& best_subpaths,
+                          int score_lower_bound,
+                          const SubpathCandidate& candidate,
+                          const Cache& cache, int& highest_pruned_bound) const
+{
+    if (!m_settings.prune_candidates) {
+        return false;
+    }
+    const auto upper_bound = candidate.act_score
+        + path_score_upper_bound(candidate.next_key, cache);
+    if (upper_bound
+        < std::max(best_subpaths.score_boost, score_lower_bound)) {
+        highest_pruned_bound = std::max(highest_pruned_bound, upper_bound);
+        return true;
     }
+    return false;
+}
 
-    return {acts, best_score_boost};
+bool Optimiser::can_prune_full_sp(const CacheValue& best_subpaths,
+                                  int score_lower_bound,
+                                  PointIndex full_sp_point,
+                                  int& highest_pruned_bound) const
+{
+    if (!m_settings.prune_candidates) {
+        return false;
+    }
+    const auto& points = m_song->points();
+    const auto upper_bound
+        = points.range_score(full_sp_point, points.end_index());
+    if (upper_bound
+        < std::max(best_subpaths.score_boost, score_lower_bound)) {
+        highest_pruned_bound = std::max(highest_pruned_bound, upper_bound);
+        return true;
+    }
+    return false;
 }
 
-Path Optimiser::optimal_path() const
+// Pruning is only safe if nothing pruned could have beaten the best subpath
+// found. A candidate is pruned against the best so far or the score's lower
+// bound, so this also catches a lower bound the key does not reach. Once out
+// of time the cache holds empty values, so the check no longer holds.
+void Optimiser::check_pruned_bound(
+    [[maybe_unused]] const CacheValue& best_subpaths,
+    [[maybe_unused]] int highest_pruned_bound,
+    [[maybe_unused]] const Cache& cache)
 {
-    Cache cache;
-    CacheKey start_key {m_song->points().cbegin(),
-                        {SightRead::Beat(NEG_INF), SpMeasure(NEG_INF)}};
-    start_key = advance_cache_key(start_key);
+    assert(cache.is_out_of_time // NOLINT
+           || highest_pruned_bound < best_subpaths.score_boost);
+}
 
-    const auto best_score_boost = get_partial_path(start_key, cache);
-    Path path {{}, best_score_boost};
+Optimiser::SubpathCandidates
+Optimiser::take_candidate_subpaths(CacheKey key, bool has_full_sp,
+                                   Cache& cache) const
+{
+    if (cache.prefetcher != nullptr) {
+        return cache.prefetcher->take(key, has_full_sp);
+    }
+    return candidate_subpaths(key, has_full_sp);
+}
 
-    while (start_key.point != m_song->points().cend()) {
-        const auto& acts = cache.paths.at(start_key).possible_next_acts;
+// If keep_ties is false then only the first of the best activations is kept,
+// which is still enough for try_previous_best_subpaths to work from.
+void Optimiser::add_subpath(CacheValue& best_subpaths,
+                            const SubpathCandidate& candidate,
+                            int rest_of_path_score_boost, bool keep_ties)
+{
+    const auto score = candidate.act_score + rest_of_path_score_boost;
+    auto& acts = best_subpaths.possible_next_acts;
+    if (score > best_subpaths.score_boost) {
+        best_subpaths.score_boost = score;
+        acts.clear();
+        acts.push_back({candidate.act, candidate.next_key});
+    } else if (score == best_subpaths.score_boost
+               && (keep_ties || acts.empty())) {
+        acts.push_back({candidate.act, candidate.next_key});
+    }
+}
+
+void Optimiser::add_full_sp_subpaths(CacheValue& best_subpaths,
+                                     const CacheValue& full_sp_subpaths,
+                                     bool keep_ties)
+{
+    if (full_sp_subpaths.score_boost > best_subpaths.score_boost) {
+        best_subpaths = full_sp_subpaths;
+    } else if (full_sp_subpaths.score_boost == best_subpaths.score_boost
+               && (keep_ties || best_subpaths.possible_next_acts.empty())) {
+        const auto& next_acts = full_sp_subpaths.possible_next_acts;
+        auto& acts = best_subpaths.possible_next_acts;
+        acts.insert(acts.end(), next_acts.cbegin(), next_acts.cend());
+    }
+}
+
+// Starts work on a subproblem for the iterative engine. This does the same
+// checks as get_partial_path and find_best_subpaths do before they recurse, so
+// a subproblem settled by try_previous_best_subpaths never gets a frame.
+void Optimiser::open_subproblem(CacheKey key, bool has_full_sp, Cache& cache,
+                                std::vector<SearchFrame>& frames) const
+{
+    if (!has_full_sp && m_terminate->load()) {
+        throw std::runtime_error("Thread halted");
+    }
+    if (has_run_out_of_time(cache)) {
+        if (has_full_sp) {
+            cache.store_full_sp_path(key.point, cache.empty_value());
+        } else {
+            cache.store_path(key, cache.empty_value());
+        }
+        return;
+    }
+    if (!has_full_sp) {
+        auto subpath_from_prev = try_previous_best_subpaths(key, cache, false);
+        if (subpath_from_prev) {
+            ++cache.stats.previous_subpaths_reused;
+            cache.store_path(key, std::move(*subpath_from_prev));
+            return;
+        }
+    }
+    ++cache.stats.subproblems_solved;
+    auto candidates = take_candidate_subpaths(key, has_full_sp, cache);
+    const auto has_full_sp_candidates
+        = candidates.full_sp_point != m_song->points().end_index();
+    frames.push_back({key, has_full_sp, std::move(candidates), 0,
+                      has_full_sp_candidates, cache.empty_value(),
+                      path_score_lower_bound(key, has_full_sp, cache),
+                      std::numeric_limits<int>::min()});
+}
+
+// Solves the same subproblems as get_partial_path and fills the cache in the
+// same order, but keeps the subproblems in progress on an explicit stack
+// instead of recursing. A frame is finished once every candidate's rest of
+// path is in the cache; until then the first missing one is opened on top of
+// it.
+int Optimiser::get_partial_path_iteratively(CacheKey key, Cache& cache) const
+{
+    const auto& points = m_song->points();
+    const auto points_end = points.end_index();
+    if (key.point == points_end) {
+        return 0;
+    }
+    if (const auto* cached_path = cache.paths.find(key);
+        cached_path != nullptr) {
+        CHOPT_TALLY(cache.stats.path_cache_hits);
+        return cached_path->score_boost;
+    }
+    CHOPT_TALLY(cache.stats.path_cache_misses);
+
+    std::vector<SearchFrame> frames;
+    open_subproblem(key, false, cache, frames);
+    while (!frames.empty()) {
+        auto& frame = frames.back();
+        if (frame.next_candidate < frame.candidates.acts.size()) {
+            const auto& candidate
+                = frame.candidates.acts[frame.next_candidate];
+            if (can_prune(frame.best_subpaths, frame.score_lower_bound,
+                          candidate, cache, frame.highest_pruned_bound)) {
+                ++cache.stats.candidates_pruned;
+                ++frame.next_candidate;
+                continue;
+            }
+            auto rest_of_path_score_boost = 0;
+            if (candidate.next_key.point != points_end) {
+                const auto* cached_path = cache.paths.find(candidate.next_key);
+                if (cached_path == nullptr) {
+                    CHOPT_TALLY(cache.stats.path_cache_misses);
+                    open_subproblem(candidate.next_key, false, cache, frames);
+                    continue;
+                }
+                CHOPT_TALLY(cache.stats.path_cache_hits);
+                rest_of_path_score_boost = cached_path->score_boost;
+            }
+            ++cache.stats.candidates_scored;
+            add_subpath(frame.best_subpaths, candidate,
+                        rest_of_path_score_boost, !m_settings.score_only);
+            ++frame.next_candidate;
+            continue;
+        }
+        if (frame.has_full_sp_candidates) {
+            const auto full_sp_point = frame.candidates.full_sp_point;
+            if (can_prune_full_sp(frame.best_subpaths,
+                                  frame.score_lower_bound, full_sp_point,
+                                  frame.highest_pruned_bound)) {
+                ++cache.stats.candidates_pruned;
+                frame.has_full_sp_candidates = false;
+                continue;
+            }
+            const auto& full_sp_path = cache.full_sp_paths[full_sp_point];
+            if (!full_sp_path.has_value()) {
+                CHOPT_TALLY(cache.stats.full_sp_cache_misses);
+                open_subproblem(
+                    {full_sp_point, points[full_sp_point - 1].hit_window_start},
+                    true, cache, frames);
+                continue;
+            }
+            CHOPT_TALLY(cache.stats.full_sp_cache_hits);
+            ++cache.stats.candidates_scored;
+            add_full_sp_subpaths(frame.best_subpaths, *full_sp_path,
+                                 !m_settings.score_only);
+            frame.has_full_sp_candidates = false;
+            continue;
+        }
+
+        auto finished_frame = std::move(frames.back());
+        frames.pop_back();
+        check_pruned_bound(finished_frame.best_subpaths,
+                           finished_frame.highest_pruned_bound, cache);
+        if (finished_frame.has_full_sp) {
+            cache.store_full_sp_path(finished_frame.key.point,
+                                     std::move(finished_frame.best_subpaths));
+        } else {
+            cache.store_path(finished_frame.key,
+                             std::move(finished_frame.best_subpaths));
+        }
+    }
+
+    return cache.paths.find(key)->score_boost;
+}
+
+Path Optimiser::optimal_path(
+    SearchStats* stats,
+    const std::function<void(const Path&)>& on_greedy_path) const
+{
+    // Everything allocated from the arena is freed at once when it goes out
+    // of scope, so it has to outlive the cache.
+    std::pmr::unsynchronized_pool_resource arena;
+    Cache cache {*m_song, m_settings.memory_limit, &arena};
+    // The clock is only read if the caller asked for stats.
+    const auto stats_time = [&] {
+        return stats != nullptr ? std::chrono::steady_clock::now()
+                                : std::chrono::steady_clock::time_point {};
+    };
+    const auto search_start = stats_time();
+#ifdef CHOPT_DETAILED_STATS
+    const auto counters_at_start = m_song->hot_path_counters();
+#endif
+    load_checkpoint(cache);
+    // The pool is kept for path reconstruction once the prefetcher is done.
+    std::optional<ThreadPool> pool;
+    std::optional<SubpathPrefetcher> prefetcher;
+    if (m_settings.threads > 1) {
+        pool.emplace(m_settings.threads);
+        prefetcher.emplace(*this, *pool, m_settings.memory_limit);
+        cache.prefetcher = &*prefetcher;
+    }
+    auto start_key = first_cache_key();
+
+    const auto solve = [&](CacheKey key) {
+        return (m_settings.dp_engine == DpEngine::Iterative)
+            ? get_partial_path_iteratively(key, cache)
+            : get_partial_path(key, cache);
+    };
+    // The segments are always solved first, whatever the number of threads,
+    // so the path found does not depend on it. With more than one thread the
+    // candidates of every segment are worked out at once.
+    const auto segment_keys = segment_start_keys();
+    cache.stats.song_segments = segment_keys.size() + 1;
+    if (prefetcher.has_value()) {
+        for (const auto& key : segment_keys) {
+            prefetcher->prefetch(key, false);
+        }
+    }
+
+    auto best_score_boost = 0;
+    try {
+        // The greedy path counts against the budget, but it is always found
+        // in full, since it is what is returned if the search makes no
+        // headway in time.
+        if (m_settings.time_budget.has_value()) {
+            cache.deadline
+                = std::chrono::steady_clock::now() + *m_settings.time_budget;
+        }
+        cache.warm_start = greedy_steps();
+        if (!cache.warm_start.empty()) {
+            cache.stats.warm_start_score_boost
+                = cache.warm_start.front().rest_of_path_score_boost;
+        }
+        if (on_greedy_path) {
+            on_greedy_path(path_from_greedy_steps(cache.warm_start));
+        }
+        for (auto key = segment_keys.crbegin(); key != segment_keys.crend();
+             ++key) {
+            solve(*key);
+        }
+        best_score_boost = solve(start_key);
+    } catch (...) {
+        // Once out of time the cache holds paths that are not optimal, and
+        // the checkpoint was already saved when time ran out.
+        if (!cache.is_out_of_time) {
+            save_checkpoint(cache);
+        }
+        throw;
+    }
+    if (!cache.is_out_of_time && !m_settings.checkpoint_file.empty()) {
+        std::error_code error;
+        std::filesystem::remove(m_settings.checkpoint_file, error);
+    }
+    if (prefetcher.has_value()) {
+        prefetcher->finish();
+        prefetcher->add_stats(cache.stats);
+        prefetcher.reset();
+        cache.prefetcher = nullptr;
+    }
+    const auto reconstruction_start = stats_time();
+#ifdef CHOPT_DETAILED_STATS
+    const auto counters_at_reconstruction = m_song->hot_path_counters();
+#endif
+    cache.stats.search_time = reconstruction_start - search_start;
+    Path path {{}, best_score_boost, cache.is_out_of_time};
+    // If time ran out before the search could beat the greedy path, then the
+    // greedy path is the best complete path found so far.
+    const auto& warm_start = cache.warm_start;
+    const auto use_warm_start = cache.is_out_of_time && !warm_start.empty()
+        && warm_start.front().rest_of_path_score_boost > best_score_boost;
+    if (use_warm_start) {
+        path.score_boost = warm_start.front().rest_of_path_score_boost;
+    }
+
+    // Ties have to be chosen between in order along the path, but the squeeze
+    // of each tie and the timings of the chosen activations can be worked out
+    // in parallel.
+    std::vector<std::tuple<ProtoActivation, CacheKey, double>> chosen_acts;
+    if (use_warm_start && !m_settings.score_only) {
+        for (const auto& step : warm_start) {
+            chosen_acts.emplace_back(step.act, step.key,
+                                     act_squeeze_level(step.act, step.key));
+        }
+    }
+    while (!use_warm_start && !m_settings.score_only
+           && start_key.point != m_song->points().end_index()) {
+        const auto* cached_path = cache.paths.find(start_key);
+        assert(cached_path != nullptr); // NOLINT
+        const auto acts = cached_path->is_trimmed
+            ? rebuild_next_acts(start_key, cached_path->score_boost, cache)
+            : cached_path->possible_next_acts;
         // We can get here if the song ends in say ES1.
         if (acts.empty()) {
             break;
         }
-        auto best_proto_act = std::get<0>(acts[0]);
-        auto best_next_key = std::get<1>(acts[0]);
-        auto best_sqz_level = act_squeeze_level(best_proto_act, start_key);
-        for (auto i = 1U; i < acts.size(); ++i) {
-            const auto [proto_act, next_key] = acts[i];
-            const auto sqz_level = act_squeeze_level(proto_act, start_key);
-            if (sqz_level < best_sqz_level) {
-                best_proto_act = std::get<0>(acts[i]);
-                best_next_key = std::get<1>(acts[i]);
-                best_sqz_level = sqz_level;
-            }
+        const auto [best_index, best_sqz_level] = least_squeeze_act(
+            acts, start_key, pool.has_value() ? &*pool : nullptr);
+        chosen_acts.emplace_back(std::get<0>(acts[best_index]), start_key,
+                                 best_sqz_level);
+        start_key = std::get<1>(acts[best_index]);
+    }
+
+    path.activations.resize(chosen_acts.size());
+    const auto add_activation = [&](std::size_t index) {
+        const auto& [proto_act, key, sqz_level] = chosen_acts[index];
+        path.activations[index] = make_activation(proto_act, key, sqz_level);
+    };
+    if (pool.has_value() && chosen_acts.size() >= MIN_PARALLEL_ACTS) {
+        parallel_for(*pool, chosen_acts.size(), add_activation);
+    } else {
+        for (auto i = 0U; i < chosen_acts.size(); ++i) {
+            add_activation(i);
         }
-        const auto min_whammy_force
-            = forced_whammy_end(best_proto_act, start_key, best_sqz_level);
-        const auto [start_pos, end_pos] = act_duration(
-            best_proto_act, start_key, best_sqz_level, min_whammy_force);
-        Activation act {best_proto_act.act_start, best_proto_act.act_end,
-                        min_whammy_force.beat, start_pos, end_pos};
-        path.activations.push_back(act);
-        start_key = best_next_key;
     }
 
+    if (stats != nullptr) {
+        *stats = cache.stats;
+        stats->reconstruction_time
+            = std::chrono::steady_clock::now() - reconstruction_start;
+#ifdef CHOPT_DETAILED_STATS
+        const auto& counters = m_song->hot_path_counters();
+        stats->valid_acts = counters.valid_acts.value()
+            - counters_at_start.valid_acts.value();
+        stats->insufficient_sp_acts = counters.insufficient_sp_acts.value()
+            - counters_at_start.insufficient_sp_acts.value();
+        stats->surplus_sp_acts = counters.surplus_sp_acts.value()
+            - counters_at_start.surplus_sp_acts.value();
+        stats->whammy_queries = counters.whammy_queries.value()
+            - counters_at_start.whammy_queries.value();
+        stats->bisection_steps = counters.bisection_steps.value()
+            - counters_at_start.bisection_steps.value();
+        stats->reconstruction_acts_checked = counters.valid_acts.value()
+            + counters.insufficient_sp_acts.value()
+            + counters.surplus_sp_acts.value()
+            - counters_at_reconstruction.valid_acts.value()
+            - counters_at_reconstruction.insufficient_sp_acts.value()
+            - counters_at_reconstruction.surplus_sp_acts.value();
+#endif
+    }
     return path;
 }
 
-double Optimiser::act_squeeze_level(ProtoActivation act, CacheKey key) const
+bool Optimiser::is_squeeze_level_valid(ProtoActivation act, CacheKey key,
+                                       double sqz_level) const
 {
-    constexpr double THRESHOLD = 0.01;
+    const auto& points = m_song->points();
+    const auto act_start = points.ptr_at(act.act_start);
+    const auto act_end = points.ptr_at(act.act_end);
+    const auto key_point = points.ptr_at(key.point);
 
-    auto min_sqz = 0.0;
-    auto max_sqz = 1.0;
     // Determines what point controls how early we can go: the previous point on
     // guitar and the current point on drums.
     const auto start_bound_point
-        = m_song->is_drums() ? act.act_start : std::prev(act.act_start);
-    while (max_sqz - min_sqz > THRESHOLD) {
-        auto trial_sqz = (min_sqz + max_sqz) / 2;
-        auto start_pos
-            = m_song->adjusted_hit_window_start(start_bound_point, trial_sqz);
-        if (start_pos.beat < key.position.beat) {
-            start_pos = key.position;
-        }
+        = m_song->is_drums() ? act_start : std::prev(act_start);
+    auto start_pos
+        = m_song->adjusted_hit_window_start(start_bound_point, sqz_level);
+    if (start_pos.beat < key.position.beat) {
+        start_pos = key.position;
+    }
 
-        const auto& [sp_bar, new_pos]
-            = m_song->total_available_sp_with_earliest_pos(
-                key.position.beat, key.point, act.act_start, start_pos);
-        start_pos = new_pos;
+    const auto& [sp_bar, new_pos]
+        = m_song->total_available_sp_with_earliest_pos(
+            key.position.beat, key_point, act_start, start_pos);
+    start_pos = new_pos;
 
-        ActivationCandidate candidate {act.act_start, act.act_end, start_pos,
-                                       sp_bar};
-        if (m_song->is_candidate_valid(candidate, trial_sqz).validity
-            == ActValidity::success) {
+    ActivationCandidate candidate {act_start, act_end, start_pos, sp_bar};
+    return m_song->is_candidate_valid(candidate, sqz_level).validity
+        == ActValidity::success;
+}
+
+double Optimiser::act_squeeze_level(ProtoActivation act, CacheKey key,
+                                    double level_to_beat) const
+{
+    constexpr double THRESHOLD = 0.01;
+
+    // The search only returns multiples of its final step, and more squeeze
+    // never makes an activation invalid, so one check a step below
+    // level_to_beat tells us if there is anything better to find.
+    auto step = 1.0;
+    while (step > THRESHOLD) {
+        step /= 2;
+    }
+    auto known_valid_sqz = 1.0;
+    if (level_to_beat < 1.0) {
+        known_valid_sqz = level_to_beat - step;
+        if (known_valid_sqz <= 0.0
+            || !is_squeeze_level_valid(act, key, known_valid_sqz)) {
+            return level_to_beat;
+        }
+    }
+
+    auto min_sqz = 0.0;
+    auto max_sqz = 1.0;
+    while (max_sqz - min_sqz > THRESHOLD) {
+        CHOPT_COUNT(m_song->hot_path_counters().bisection_steps);
+        auto trial_sqz = (min_sqz + max_sqz) / 2;
+        if (trial_sqz >= known_valid_sqz
+            || is_squeeze_level_valid(act, key, trial_sqz)) {
             max_sqz = trial_sqz;
         } else {
             min_sqz = trial_sqz;
@@ -406,26 +1909,30 @@ SpPosition Optimiser::forced_whammy_end(ProtoActivation act, CacheKey key,
     constexpr double POS_INF = std::numeric_limits<double>::infinity();
     constexpr double THRESHOLD = 0.01;
 
-    auto next_point = std::next(act.act_end);
+    const auto& points = m_song->points();
+    const auto act_start = points.ptr_at(act.act_start);
+    const auto act_end = points.ptr_at(act.act_end);
+    const auto key_point = points.ptr_at(key.point);
+    auto next_point = std::next(act_end);
 
-    if (next_point == m_song->points().cend()) {
+    if (next_point == points.cend()) {
         return {SightRead::Beat {POS_INF}, SpMeasure {POS_INF}};
     }
 
-    auto prev_point = std::prev(act.act_start);
+    auto prev_point = std::prev(act_start);
     auto min_whammy_force = key.position;
     auto max_whammy_force = next_point->hit_window_end;
     auto start_pos = m_song->adjusted_hit_window_start(prev_point, sqz_level);
     while ((max_whammy_force.beat - min_whammy_force.beat).value()
            > THRESHOLD) {
+        CHOPT_COUNT(m_song->hot_path_counters().bisection_steps);
         auto mid_beat
             = (min_whammy_force.beat + max_whammy_force.beat) * (1.0 / 2);
         auto mid_meas = m_song->sp_time_map().to_sp_measures(mid_beat);
         SpPosition mid_pos {mid_beat, mid_meas};
-        auto sp_bar = m_song->total_available_sp(key.position.beat, key.point,
-                                                 act.act_start, mid_beat);
-        ActivationCandidate candidate {act.act_start, act.act_end, start_pos,
-                                       sp_bar};
+        auto sp_bar = m_song->total_available_sp(key.position.beat, key_point,
+                                                 act_start, mid_beat);
+        ActivationCandidate candidate {act_start, act_end, start_pos, sp_bar};
         auto result = m_song->is_candidate_valid(candidate, sqz_level, mid_pos);
         if (result.validity == ActValidity::success) {
             min_whammy_force = mid_pos;
@@ -443,21 +1950,26 @@ Optimiser::act_duration(ProtoActivation act, CacheKey key, double sqz_level,
 {
     constexpr double THRESHOLD = 0.01;
 
+    const auto& points = m_song->points();
+    const auto act_start = points.ptr_at(act.act_start);
+    const auto act_end = points.ptr_at(act.act_end);
+    const auto key_point = points.ptr_at(key.point);
+
     // Determines what point controls how early we can go: the previous point on
     // guitar and the current point on drums.
     const auto start_bound_point
-        = m_song->is_drums() ? act.act_start : std::prev(act.act_start);
+        = m_song->is_drums() ? act_start : std::prev(act_start);
     auto min_pos
         = m_song->adjusted_hit_window_start(start_bound_point, sqz_level);
-    auto max_pos = m_song->adjusted_hit_window_end(act.act_start, sqz_level);
+    auto max_pos = m_song->adjusted_hit_window_end(act_start, sqz_level);
     auto sp_bar = m_song->total_available_sp(
-        key.position.beat, key.point, act.act_start, min_whammy_force.beat);
+        key.position.beat, key_point, act_start, min_whammy_force.beat);
     while ((max_pos.beat - min_pos.beat).value() > THRESHOLD) {
+        CHOPT_COUNT(m_song->hot_path_counters().bisection_steps);
         auto trial_beat = (min_pos.beat + max_pos.beat) * (1.0 / 2);
         auto trial_meas = m_song->sp_time_map().to_sp_measures(trial_beat);
         SpPosition trial_pos {trial_beat, trial_meas};
-        ActivationCandidate candidate {act.act_start, act.act_end, trial_pos,
-                                       sp_bar};
+        ActivationCandidate candidate {act_start, act_end, trial_pos, sp_bar};
         if (m_song->is_candidate_valid(candidate, sqz_level, min_whammy_force)
                 .validity
             == ActValidity::success) {
@@ -467,9 +1979,72 @@ Optimiser::act_duration(ProtoActivation act, CacheKey key, double sqz_level,
         }
     }
 
-    ActivationCandidate candidate {act.act_start, act.act_end, min_pos, sp_bar};
+    ActivationCandidate candidate {act_start, act_end, min_pos, sp_bar};
     auto result
         = m_song->is_candidate_valid(candidate, sqz_level, min_whammy_force);
     assert(result.validity == ActValidity::success); // NOLINT
     return {min_pos.beat, result.ending_position.beat};
 }
+
+Activation Optimiser::make_activation(ProtoActivation act, CacheKey key,
+                                      double sqz_level) const
+{
+    const auto min_whammy_force = forced_whammy_end(act, key, sqz_level);
+    const auto [start_pos, end_pos]
+        = act_duration(act, key, sqz_level, min_whammy_force);
+    const auto& points = m_song->points();
+    return {points.ptr_at(act.act_start), points.ptr_at(act.act_end),
+            min_whammy_force.beat, start_pos, end_pos};
+}
+
+// Returns the index of the first activation needing the least squeeze, along
+// with that squeeze. Without a pool each activation is only checked against
+// the best squeeze so far, which is quicker than finding every squeeze.
+std::tuple<std::size_t, double>
+Optimiser::least_squeeze_act(const NextActs& acts, CacheKey key,
+                             ThreadPool* pool) const
+{
+    if (pool == nullptr || acts.size() < MIN_PARALLEL_ACTS) {
+        std::size_t best_index = 0;
+        auto best_sqz_level = act_squeeze_level(std::get<0>(acts[0]), key);
+        for (auto i = 1U; i < acts.size(); ++i) {
+            const auto sqz_level
+                = act_squeeze_level(std::get<0>(acts[i]), key, best_sqz_level);
+            if (sqz_level < best_sqz_level) {
+                best_index = i;
+                best_sqz_level = sqz_level;
+            }
+        }
+        return {best_index, best_sqz_level};
+    }
+
+    std::vector<double> sqz_levels(acts.size());
+    parallel_for(*pool, acts.size(), [&](auto i) {
+        sqz_levels[i] = act_squeeze_level(std::get<0>(acts[i]), key);
+    });
+    const auto best_sqz_level
+        = std::min_element(sqz_levels.cbegin(), sqz_levels.cend());
+    return {static_cast<std::size_t>(
+                std::distance(sqz_levels.cbegin(), best_sqz_level)),
+            *best_sqz_level};
+}
+
+Path Optimiser::greedy_path() const
+{
+    return path_from_greedy_steps(greedy_steps());
+}
+
+Path Optimiser::path_from_greedy_steps(
+    const std::vector<GreedyStep>& steps) const
+{
+    Path path {{}, 0, true};
+    if (!steps.empty()) {
+        path.score_boost = steps.front().rest_of_path_score_boost;
+    }
+    for (const auto& step : steps) {
+        const auto sqz_level = act_squeeze_level(step.act, step.key);
+        path.activations.push_back(
+            make_activation(step.act, step.key, sqz_level));
+    }
+    return path;
+}
@@ -46,6 +46,31 @@ double song_tick_gap(int resolution, const Engine& engine)
     return std::max(quotient, 1.0);
 }
 
+// The engine rules used for every note and sustain, read once per track so
+// the loops over notes and sustain ticks make no virtual calls for them.
+struct NoteRules {
+    int base_note_value;
+    int base_cymbal_value;
+    double tick_gap;
+    double burst_length;
+    SustainTicksMetric sustain_ticks_metric;
+    SustainRoundingPolicy sustain_rounding;
+    bool chords_multiply_sustains;
+    bool merge_uneven_sustains;
+};
+
+NoteRules note_rules(int resolution, const Engine& engine)
+{
+    return {engine.base_note_value(),
+            engine.base_cymbal_value(),
+            song_tick_gap(resolution, engine),
+            engine.burst_size() * resolution,
+            engine.sustain_ticks_metric(),
+            engine.sustain_rounding(),
+            engine.chords_multiply_sustains(),
+            engine.merge_uneven_sustains()};
+}
+
 template <typename OutputIt>
 void append_sustain_point(OutputIt points, SightRead::Beat beat,
                           SpMeasure measure, int value)
@@ -65,18 +90,18 @@ template <typename OutputIt>
 void append_sustain_points(OutputIt points, SightRead::Tick position,
                            SightRead::Tick sust_length, int resolution,
                            int chord_size, const SpTimeMap& time_map,
-                           const Engine& engine)
+                           const NoteRules& rules)
 {
     constexpr double HALF_RES_OFFSET = 0.5;
     const double float_res = resolution;
     double float_pos = position.value();
-    double tick_gap = song_tick_gap(resolution, engine);
+    double tick_gap = rules.tick_gap;
 
-    switch (engine.sustain_ticks_metric()) {
+    switch (rules.sustain_ticks_metric) {
     case SustainTicksMetric::Beat: {
         double float_sust_len = sust_length.value();
         auto float_sust_ticks = sust_length.value() / tick_gap;
-        switch (engine.sustain_rounding()) {
+        switch (rules.sustain_rounding) {
         case SustainRoundingPolicy::RoundUp:
             float_sust_ticks = std::ceil(float_sust_ticks);
             break;
@@ -85,13 +110,12 @@ void append_sustain_points(OutputIt points, SightRead::Tick position,
             break;
         }
         auto sust_ticks = static_cast<int>(float_sust_ticks);
-        if (engine.chords_multiply_sustains()) {
+        if (rules.chords_multiply_sustains) {
             tick_gap /= chord_size;
             sust_ticks *= chord_size;
         }
 
-        while (float_sust_len > engine.burst_size() * resolution
-               && sust_ticks > 0) {
+        while (float_sust_len > rules.burst_length && sust_ticks > 0) {
             float_pos += tick_gap;
             float_sust_len -= tick_gap;
             const SightRead::Beat beat {(float_pos - HALF_RES_OFFSET)
@@ -112,7 +136,7 @@ void append_sustain_points(OutputIt points, SightRead::Tick position,
         constexpr double SP_BEATS_PER_MEASURE = 4.0;
         const double sustain_end = (position + sust_length).value();
         tick_gap /= SP_BEATS_PER_MEASURE * resolution;
-        if (engine.chords_multiply_sustains()) {
+        if (rules.chords_multiply_sustains) {
             tick_gap /= chord_size;
         }
 
@@ -150,13 +174,13 @@ void append_note_points(std::vector<SightRead::Note>::const_iterator note,
                         OutputIt points, const SpTimeMap& time_map,
                         int resolution, bool is_note_sp_ender,
                         bool is_unison_sp_ender, double squeeze,
-                        const Engine& engine,
+                        const NoteRules& rules, const Engine& engine,
                         const SightRead::DrumSettings& drum_settings)
 {
-    auto note_value = engine.base_note_value();
+    auto note_value = rules.base_note_value;
     if (note->flags & SightRead::FLAGS_DRUMS) {
         if (note->flags & SightRead::FLAGS_CYMBAL) {
-            note_value = engine.base_cymbal_value();
+            note_value = rules.base_cymbal_value;
         }
         if (note->flags & (SightRead::FLAGS_GHOST | SightRead::FLAGS_ACCENT)) {
             note_value *= 2;
@@ -207,14 +231,14 @@ void append_note_points(std::vector<SightRead::Note>::const_iterator note,
         max_length = std::max(length, max_length);
     }
 
-    if (min_length == max_length || engine.merge_uneven_sustains()) {
+    if (min_length == max_length || rules.merge_uneven_sustains) {
         append_sustain_points(points, pos, min_length, resolution, chord_size,
-                              time_map, engine);
+                              time_map, rules);
     } else {
         for (auto length : note->lengths) {
             if (length != SightRead::Tick {-1}) {
                 append_sustain_points(points, pos, length, resolution,
-                                      chord_size, time_map, engine);
+                                      chord_size, time_map, rules);
             }
         }
     }
@@ -277,26 +301,17 @@ void shift_points_by_video_lag(std::vector<Point>& points,
 }
 
 template <typename P>
-std::vector<PointPtr> next_matching_vector(const std::vector<Point>& points,
-                                           P predicate)
+std::vector<PointIndex> next_matching_vector(const std::vector<Point>& points,
+                                             P predicate)
 {
-    if (points.empty()) {
-        return {};
-    }
-    std::vector<PointPtr> next_matching_points;
-    auto next_matching_point = points.cend();
-    for (auto p = std::prev(points.cend());; --p) {
-        if (predicate(*p)) {
-            next_matching_point = p;
-        }
-        next_matching_points.push_back(next_matching_point);
-        // We can't have the loop condition be p >= points.cbegin() because
-        // decrementing past .begin() is undefined behaviour.
-        if (p == points.cbegin()) {
-            break;
+    std::vector<PointIndex> next_matching_points(points.size());
+    auto next_matching_point = static_cast<PointIndex>(points.size());
+    for (auto i = points.size(); i > 0; --i) {
+        if (predicate(points[i - 1])) {
+            next_matching_point = static_cast<PointIndex>(i - 1);
         }
+        next_matching_points[i - 1] = next_matching_point;
     }
-    std::reverse(next_matching_points.begin(), next_matching_points.end());
     return next_matching_points;
 }
 
@@ -321,16 +336,18 @@ void apply_multiplier(std::vector<Point>& points, const Engine& engine)
 {
     constexpr int COMBO_PER_MULTIPLIER_LEVEL = 10;
 
+    const auto max_multiplier = engine.max_multiplier();
+    const auto delayed_multiplier = engine.delayed_multiplier();
     auto combo = 0;
     for (auto& point : points) {
         if (!point.is_hold_point) {
             ++combo;
         }
         auto multiplier = std::min(combo / COMBO_PER_MULTIPLIER_LEVEL + 1,
-                                   engine.max_multiplier());
-        if (!point.is_hold_point && engine.delayed_multiplier()) {
+                                   max_multiplier);
+        if (!point.is_hold_point && delayed_multiplier) {
             multiplier = std::min((combo - 1) / COMBO_PER_MULTIPLIER_LEVEL + 1,
-                                  engine.max_multiplier());
+                                  max_multiplier);
         }
         point.value *= multiplier;
     }
@@ -364,25 +381,30 @@ std::vector<Point> unmultiplied_points(
 {
     const auto& notes = track.notes();
     const auto bre = track.bre();
+    const auto resolution = track.global_data().resolution();
+    const auto rules = note_rules(resolution, engine);
+    const auto has_bres = engine.has_bres();
+    const auto has_unison_bonuses = engine.has_unison_bonuses();
+    const auto track_type = track.track_type();
 
     std::vector<Point> points;
     auto current_phrase = track.sp_phrases().cbegin();
 
     for (auto p = notes.cbegin(); p != notes.cend();) {
-        if (track.track_type() == SightRead::TrackType::Drums) {
+        if (track_type == SightRead::TrackType::Drums) {
             if (p->is_skipped_kick(drum_settings)) {
                 ++p;
                 continue;
             }
         }
-        if (engine.has_bres() && bre.has_value() && p->position >= bre->start) {
+        if (has_bres && bre.has_value() && p->position >= bre->start) {
             break;
         }
         const auto search_start
-            = has_split_notes(track.track_type()) ? std::next(p) : p;
+            = has_split_notes(track_type) ? std::next(p) : p;
         const auto q = std::find_if_not(
             search_start, notes.cend(), [=](const auto& note) {
-                return is_note_skippable(*p, note, track.track_type(),
+                return is_note_skippable(*p, note, track_type,
                                          drum_settings);
             });
         auto is_note_sp_ender = false;
@@ -392,7 +414,7 @@ std::vector<Point> unmultiplied_points(
             && ((q == notes.cend())
                 || !phrase_contains_pos(*current_phrase, q->position))) {
             is_note_sp_ender = true;
-            if (engine.has_unison_bonuses()
+            if (has_unison_bonuses
                 && std::find(unison_phrases.cbegin(), unison_phrases.cend(),
                              current_phrase->position)
                     != unison_phrases.cend()) {
@@ -401,8 +423,8 @@ std::vector<Point> unmultiplied_points(
             ++current_phrase;
         }
         append_note_points(p, notes, std::back_inserter(points), time_map,
-                           track.global_data().resolution(), is_note_sp_ender,
-                           is_unison_sp_ender, squeeze_settings.squeeze, engine,
+                           resolution, is_note_sp_ender, is_unison_sp_ender,
+                           squeeze_settings.squeeze, rules, engine,
                            drum_settings);
         p = q;
     }
@@ -473,13 +495,17 @@ std::string colours_string(const SightRead::Note& note)
     return colours;
 }
 
-std::vector<PointPtr>
+std::vector<PointIndex>
 first_after_current_sp_vector(const std::vector<Point>& points,
                               const SightRead::NoteTrack& track,
                               const Engine& engine)
 {
-    std::vector<PointPtr> results;
+    const auto index_of = [&](auto p) {
+        return static_cast<PointIndex>(std::distance(points.cbegin(), p));
+    };
+    std::vector<PointIndex> results;
     const auto& tempo_map = track.global_data().tempo_map();
+    const auto overlaps = engine.overlaps();
     auto current_sp = track.sp_phrases().cbegin();
     for (auto p = points.cbegin(); p < points.cend();) {
         current_sp
@@ -494,15 +520,15 @@ first_after_current_sp_vector(const std::vector<Point>& points,
             sp_end
                 = tempo_map.to_beats(current_sp->position + current_sp->length);
         }
-        if (p->position.beat < sp_start || engine.overlaps()) {
-            results.push_back(++p);
+        if (p->position.beat < sp_start || overlaps) {
+            results.push_back(index_of(++p));
             continue;
         }
         const auto q = std::find_if(std::next(p), points.cend(), [&](auto pt) {
             return pt.position.beat >= sp_end;
         });
         while (p < q) {
-            results.push_back(q);
+            results.push_back(index_of(q));
             ++p;
         }
     }
@@ -545,18 +571,24 @@ points_from_track(const SightRead::NoteTrack& track, const SpTimeMap& time_map,
     return points;
 }
 
-std::vector<PointPtr> next_non_hold_vector(const std::vector<Point>& points)
+std::vector<PointIndex> next_non_hold_vector(const std::vector<Point>& points)
 {
     return next_matching_vector(points,
                                 [](const auto& p) { return !p.is_hold_point; });
 }
 
-std::vector<PointPtr> next_sp_note_vector(const std::vector<Point>& points)
+std::vector<PointIndex> next_sp_note_vector(const std::vector<Point>& points)
 {
     return next_matching_vector(
         points, [](const auto& p) { return p.is_sp_granting_note; });
 }
 
+std::vector<PointIndex> next_fill_point_vector(const std::vector<Point>& points)
+{
+    return next_matching_vector(
+        points, [](const auto& p) { return p.fill_start.has_value(); });
+}
+
 std::vector<int> score_totals(const std::vector<Point>& points)
 {
     std::vector<int> scores;
@@ -570,6 +602,24 @@ std::vector<int> score_totals(const std::vector<Point>& points)
     return scores;
 }
 
+std::vector<int> phrase_count_totals(const std::vector<Point>& points)
+{
+    std::vector<int> counts;
+    counts.reserve(points.size() + 1);
+    counts.push_back(0);
+    auto sum = 0;
+    for (const auto& p : points) {
+        if (p.is_sp_granting_note) {
+            ++sum;
+            if (p.is_unison_sp_granting_note) {
+                ++sum;
+            }
+        }
+        counts.push_back(sum);
+    }
+    return counts;
+}
+
 std::vector<std::tuple<SpPosition, int>>
 solo_boosts_from_solos(const std::vector<SightRead::Solo>& solos,
                        const SpTimeMap& time_map)
@@ -597,41 +647,49 @@ PointSet::PointSet(const SightRead::NoteTrack& track, const SpTimeMap& time_map,
                                                               engine)}
     , m_next_non_hold_point {next_non_hold_vector(m_points)}
     , m_next_sp_granting_note {next_sp_note_vector(m_points)}
+    , m_next_fill_point {next_fill_point_vector(m_points)}
     , m_solo_boosts {solo_boosts_from_solos(track.solos(drum_settings),
                                             time_map)}
     , m_cumulative_score_totals {score_totals(m_points)}
+    , m_cumulative_phrase_counts {phrase_count_totals(m_points)}
     , m_video_lag {squeeze_settings.video_lag}
     , m_colours {note_colours(track.notes(), m_points)}
 {
+    assert(m_points.size() < std::numeric_limits<PointIndex>::max()); // NOLINT
+}
+
+PointIndex PointSet::first_hit_window_end_after(PointIndex start,
+                                                SpMeasure measure) const
+{
+    const auto first_after
+        = std::find_if_not(ptr_at(start), cend(), [&](const auto& p) {
+              return p.hit_window_end.sp_measure <= measure;
+          });
+    return index_of(first_after);
 }
 
 PointPtr PointSet::first_after_current_phrase(PointPtr point) const
 {
-    const auto index
-        = static_cast<std::size_t>(std::distance(m_points.cbegin(), point));
-    return m_first_after_current_sp[index];
+    return ptr_at(first_after_current_phrase(index_of(point)));
 }
 
 PointPtr PointSet::next_non_hold_point(PointPtr point) const
 {
-    const auto index
-        = static_cast<std::size_t>(std::distance(m_points.cbegin(), point));
-    return m_next_non_hold_point[index];
+    return ptr_at(next_non_hold_point(index_of(point)));
 }
 
 PointPtr PointSet::next_sp_granting_note(PointPtr point) const
 {
-    const auto index
-        = static_cast<std::size_t>(std::distance(m_points.cbegin(), point));
-    return m_next_sp_granting_note[index];
+    return ptr_at(next_sp_granting_note(index_of(point)));
+}
+
+PointPtr PointSet::next_fill_point(PointPtr point) const
+{
+    return ptr_at(next_fill_point(index_of(point)));
 }
 
-int PointSet::range_score(PointPtr start, PointPtr end) const
+int PointSet::range_phrase_count(PointPtr start, PointPtr end) const
 {
-    const auto start_index
-        = static_cast<std::size_t>(std::distance(m_points.cbegin(), start));
-    const auto end_index
-        = static_cast<std::size_t>(std::distance(m_points.cbegin(), end));
-    return m_cumulative_score_totals[end_index]
-        - m_cumulative_score_totals[start_index];
+    return m_cumulative_phrase_counts[index_of(end)]
+        - m_cumulative_phrase_counts[index_of(start)];
 }
@@ -46,16 +46,29 @@ int bre_boost(const SightRead::NoteTrack& track, const Engine& engine)
 
 SpBar ProcessedSong::sp_from_phrases(PointPtr begin, PointPtr end) const
 {
-    SpBar sp_bar {0.0, 0.0};
-    for (auto p = m_points.next_sp_granting_note(begin); p < end;
-         p = m_points.next_sp_granting_note(std::next(p))) {
-        sp_bar.add_phrase();
-        if (p->is_unison_sp_granting_note) {
-            sp_bar.add_phrase();
-        }
+    constexpr double SP_PHRASE_AMOUNT = 0.25;
+
+    if (begin >= end) {
+        return {0.0, 0.0};
     }
+    const auto phrase_count = m_points.range_phrase_count(begin, end);
+    const auto sp = std::min(phrase_count * SP_PHRASE_AMOUNT, 1.0);
+    return {sp, sp};
+}
 
-    return sp_bar;
+double ProcessedSong::available_whammy(SightRead::Beat start,
+                                       SightRead::Beat end) const
+{
+    CHOPT_COUNT(m_hot_path_counters.whammy_queries);
+    return m_sp_data->available_whammy(start, end);
+}
+
+double ProcessedSong::available_whammy(SightRead::Beat start,
+                                       SightRead::Beat end,
+                                       SightRead::Beat note_pos) const
+{
+    CHOPT_COUNT(m_hot_path_counters.whammy_queries);
+    return m_sp_data->available_whammy(start, end, note_pos);
 }
 
 ProcessedSong::ProcessedSong(const SightRead::NoteTrack& track,
@@ -65,10 +78,28 @@ ProcessedSong::ProcessedSong(const SightRead::NoteTrack& track,
                              const Engine& engine,
                              const std::vector<SightRead::Tick>& od_beats,
                              const std::vector<SightRead::Tick>& unison_phrases)
+    : ProcessedSong {track,
+                     time_map,
+                     std::make_shared<const SpData>(
+                         track, time_map, od_beats, squeeze_settings, engine),
+                     squeeze_settings,
+                     drum_settings,
+                     engine,
+                     unison_phrases}
+{
+}
+
+ProcessedSong::ProcessedSong(const SightRead::NoteTrack& track,
+                             SpTimeMap time_map,
+                             std::shared_ptr<const SpData> sp_data,
+                             const SqueezeSettings& squeeze_settings,
+                             const SightRead::DrumSettings& drum_settings,
+                             const Engine& engine,
+                             const std::vector<SightRead::Tick>& unison_phrases)
     : m_time_map {std::move(time_map)}
     , m_points {track,         m_time_map, unison_phrases, squeeze_settings,
                 drum_settings, engine}
-    , m_sp_data {track, m_time_map, od_beats, squeeze_settings, engine}
+    , m_sp_data {std::move(sp_data)}
     , m_minimum_sp_to_activate {engine.minimum_sp_to_activate()}
     , m_total_bre_boost {bre_boost(track, engine)}
     , m_base_score {track.base_score(drum_settings)}
@@ -89,20 +120,18 @@ SpBar ProcessedSong::total_available_sp(
     auto sp_bar = sp_from_phrases(first_point, act_start);
 
     if (start >= required_whammy_end) {
-        sp_bar.max()
-            += m_sp_data.available_whammy(start, act_start->position.beat);
+        sp_bar.max() += available_whammy(start, act_start->position.beat);
         sp_bar.max() = std::min(sp_bar.max(), 1.0);
     } else if (required_whammy_end >= act_start->position.beat) {
-        sp_bar.min()
-            += m_sp_data.available_whammy(start, act_start->position.beat);
+        sp_bar.min() += available_whammy(start, act_start->position.beat);
         sp_bar.min() = std::min(sp_bar.min(), 1.0);
         sp_bar.max() = sp_bar.min();
     } else {
-        sp_bar.min() += m_sp_data.available_whammy(start, required_whammy_end);
+        sp_bar.min() += available_whammy(start, required_whammy_end);
         sp_bar.min() = std::min(sp_bar.min(), 1.0);
         sp_bar.max() = sp_bar.min();
-        sp_bar.max() += m_sp_data.available_whammy(required_whammy_end,
-                                                   act_start->position.beat);
+        sp_bar.max()
+            += available_whammy(required_whammy_end, act_start->position.beat);
         sp_bar.max() = std::min(sp_bar.max(), 1.0);
     }
 
@@ -118,7 +147,7 @@ ProcessedSong::total_available_sp_with_earliest_pos(
 
     auto sp_bar = sp_from_phrases(first_point, act_start);
 
-    sp_bar.max() += m_sp_data.available_whammy(
+    sp_bar.max() += available_whammy(
         start, earliest_potential_pos.beat, act_start->position.beat);
     sp_bar.max() = std::min(sp_bar.max(), 1.0);
 
@@ -129,16 +158,16 @@ ProcessedSong::total_available_sp_with_earliest_pos(
     const auto extra_sp_required = m_minimum_sp_to_activate - sp_bar.max();
     auto first_beat = earliest_potential_pos.beat;
     auto last_beat = act_start->position.beat;
-    if (m_sp_data.available_whammy(first_beat, last_beat,
-                                   act_start->position.beat)
+    if (available_whammy(first_beat, last_beat, act_start->position.beat)
         < extra_sp_required) {
         return {sp_bar, earliest_potential_pos};
     }
 
     while (last_beat - first_beat > BEAT_EPSILON) {
         const auto mid_beat = (first_beat + last_beat) * 0.5;
-        if (m_sp_data.available_whammy(earliest_potential_pos.beat, mid_beat,
-                                       act_start->position.beat)
+        CHOPT_COUNT(m_hot_path_counters.bisection_steps);
+        if (available_whammy(earliest_potential_pos.beat, mid_beat,
+                             act_start->position.beat)
             < extra_sp_required) {
             first_beat = mid_beat;
         } else {
@@ -146,7 +175,7 @@ ProcessedSong::total_available_sp_with_earliest_pos(
         }
     }
 
-    sp_bar.max() += m_sp_data.available_whammy(
+    sp_bar.max() += available_whammy(
         earliest_potential_pos.beat, last_beat, act_start->position.beat);
     sp_bar.max() = std::min(sp_bar.max(), 1.0);
 
@@ -190,173 +219,257 @@ SpPosition ProcessedSong::adjusted_hit_window_end(PointPtr point,
     return {adj_end_b, adj_end_m};
 }
 
-class SpStatus {
-private:
-    SpPosition m_position;
-    double m_sp;
-    bool m_overlap_engine;
-    static constexpr double MEASURES_PER_BAR = 8.0;
-
-public:
-    SpStatus(SpPosition position, double sp, bool overlap_engine)
-        : m_position {position}
-        , m_sp {sp}
-        , m_overlap_engine {overlap_engine}
-    {
+void SpStatus::advance_whammy_max(SpPosition end_position,
+                                  const SpData& sp_data, bool does_overlap)
+{
+    if (does_overlap) {
+        m_sp = sp_data.propagate_sp_over_whammy_max(m_position, end_position,
+                                                    m_sp);
+    } else {
+        m_sp -= (end_position.sp_measure - m_position.sp_measure).value()
+            / MEASURES_PER_BAR;
     }
+    m_position = end_position;
+}
 
-    [[nodiscard]] SpPosition position() const { return m_position; }
-    [[nodiscard]] double sp() const { return m_sp; }
-
-    void add_phrase()
-    {
-        constexpr double SP_PHRASE_AMOUNT = 0.25;
+void SpStatus::update_early_end(SpPosition sp_note_start, const SpData& sp_data,
+                                SpPosition required_whammy_end)
+{
+    if (!m_overlap_engine) {
+        required_whammy_end = {SightRead::Beat {0.0}, SpMeasure {0.0}};
+    }
+    m_sp = sp_data.propagate_sp_over_whammy_min(m_position, sp_note_start, m_sp,
+                                                required_whammy_end);
+    if (sp_note_start.beat > m_position.beat) {
+        m_position = sp_note_start;
+    }
+}
 
-        m_sp += SP_PHRASE_AMOUNT;
-        m_sp = std::min(m_sp, 1.0);
+void SpStatus::update_late_end(SpPosition sp_note_start, SpPosition sp_note_end,
+                               const SpData& sp_data, bool does_overlap)
+{
+    if (sp_note_start.beat < m_position.beat) {
+        sp_note_start = m_position;
     }
 
-    void advance_whammy_max(SpPosition end_position, const SpData& sp_data,
-                            bool does_overlap)
-    {
-        if (does_overlap) {
-            m_sp = sp_data.propagate_sp_over_whammy_max(m_position,
-                                                        end_position, m_sp);
-        } else {
-            m_sp -= (end_position.sp_measure - m_position.sp_measure).value()
-                / MEASURES_PER_BAR;
+    advance_whammy_max(sp_note_start, sp_data, does_overlap);
+    if (m_sp < 0.0) {
+        return;
+    }
+    // We might run out of SP between sp_note_start and sp_note_end. In this
+    // case we just hit the note as early as possible.
+    if (does_overlap) {
+        const auto new_sp = sp_data.propagate_sp_over_whammy_max(
+            sp_note_start, sp_note_end, m_sp);
+        if (new_sp >= 0.0) {
+            m_sp = new_sp;
+            m_position = sp_note_end;
         }
-        m_position = end_position;
     }
+}
 
-    void update_early_end(SpPosition sp_note_start, const SpData& sp_data,
-                          SpPosition required_whammy_end)
-    {
-        if (!m_overlap_engine) {
-            required_whammy_end = {SightRead::Beat {0.0}, SpMeasure {0.0}};
-        }
-        m_sp = sp_data.propagate_sp_over_whammy_min(m_position, sp_note_start,
-                                                    m_sp, required_whammy_end);
-        if (sp_note_start.beat > m_position.beat) {
-            m_position = sp_note_start;
-        }
+ActEndSweep::ActEndSweep(const ProcessedSong& song, PointPtr act_start,
+                         SpPosition earliest_activation_point, SpBar sp_bar,
+                         double squeeze, SpPosition required_whammy_end)
+    : m_song {&song}
+    , m_act_start {act_start}
+    , m_earliest_activation_point {earliest_activation_point}
+    , m_sp_bar {sp_bar}
+    , m_squeeze {squeeze}
+    , m_required_whammy_end {required_whammy_end}
+    , m_late_end_start {song.adjusted_hit_window_end(act_start, squeeze)}
+    , m_early_end_status {earliest_activation_point, 0.0, song.m_overlaps}
+    , m_late_end_status {m_late_end_start, 0.0, song.m_overlaps}
+    , m_next_sp_note {act_start}
+    , m_commit_act_end {act_start}
+    , m_commit_limit {earliest_activation_point}
+    , m_can_activate {
+          sp_bar.full_enough_to_activate(song.m_minimum_sp_to_activate)}
+{
+    if (!m_can_activate) {
+        return;
     }
+    auto late_end_sp = sp_bar.max();
+    late_end_sp += song.available_whammy(earliest_activation_point.beat,
+                                         act_start->position.beat);
+    m_late_end_sp = std::min(late_end_sp, 1.0);
+    reset();
+}
+
+void ActEndSweep::reset()
+{
+    const auto overlaps = m_song->m_overlaps;
+    m_early_end_status = {
+        m_earliest_activation_point,
+        std::max(m_sp_bar.min(), m_song->m_minimum_sp_to_activate), overlaps};
+    m_late_end_status = {m_late_end_start, m_late_end_sp, overlaps};
+    m_next_sp_note = m_song->m_points.next_sp_granting_note(m_act_start);
+    m_commit_act_end = m_act_start;
+    m_commit_limit = m_late_end_start;
+    m_is_short_of_sp = false;
+}
 
-    void update_late_end(SpPosition sp_note_start, SpPosition sp_note_end,
-                         const SpData& sp_data, bool does_overlap)
-    {
-        if (sp_note_start.beat < m_position.beat) {
-            sp_note_start = m_position;
+bool ActEndSweep::add_sp_note(PointPtr sp_note, SpPosition ending_pos,
+                              SpStatus& early_end_status,
+                              SpStatus& late_end_status) const
+{
+    const auto& sp_data = *m_song->m_sp_data;
+    const auto overlaps = m_song->m_overlaps;
+    auto p_start = m_song->adjusted_hit_window_start(sp_note, m_squeeze);
+    if (p_start.beat < m_earliest_activation_point.beat) {
+        p_start = m_earliest_activation_point;
+    }
+    auto p_end = m_song->adjusted_hit_window_end(sp_note, m_squeeze);
+    if (p_end.beat > ending_pos.beat) {
+        p_end = ending_pos;
+    }
+    late_end_status.update_late_end(p_start, p_end, sp_data, overlaps);
+    if (late_end_status.sp() < 0.0) {
+        return false;
+    }
+    early_end_status.update_early_end(p_start, sp_data, m_required_whammy_end);
+    if (overlaps) {
+        early_end_status.add_phrase();
+        late_end_status.add_phrase();
+        if (sp_note->is_unison_sp_granting_note) {
+            early_end_status.add_phrase();
+            late_end_status.add_phrase();
         }
+    }
+    return true;
+}
 
-        advance_whammy_max(sp_note_start, sp_data, does_overlap);
-        if (m_sp < 0.0) {
+// An SP granting note is committed to the carried statuses once its timing
+// window and the start of the late end status both end before ending_pos,
+// since then nothing about it depends on where the activation ends.
+void ActEndSweep::commit_sp_notes(PointPtr act_end, SpPosition ending_pos)
+{
+    if (ending_pos.beat < m_late_end_start.beat) {
+        return;
+    }
+    const auto& points = m_song->m_points;
+    while (!m_is_short_of_sp && m_next_sp_note < act_end) {
+        const auto p_end
+            = m_song->adjusted_hit_window_end(m_next_sp_note, m_squeeze);
+        if (p_end.beat > ending_pos.beat) {
             return;
         }
-        // We might run out of SP between sp_note_start and sp_note_end. In this
-        // case we just hit the note as early as possible.
-        if (does_overlap) {
-            const auto new_sp = sp_data.propagate_sp_over_whammy_max(
-                sp_note_start, sp_note_end, m_sp);
-            if (new_sp >= 0.0) {
-                m_sp = new_sp;
-                m_position = sp_note_end;
-            }
+        if (!add_sp_note(m_next_sp_note, ending_pos, m_early_end_status,
+                         m_late_end_status)) {
+            m_is_short_of_sp = true;
+            return;
+        }
+        if (p_end.beat > m_commit_limit.beat) {
+            m_commit_limit = p_end;
         }
+        m_commit_act_end = act_end;
+        m_next_sp_note
+            = points.next_sp_granting_note(std::next(m_next_sp_note));
     }
-};
+}
 
-ActResult
-ProcessedSong::is_candidate_valid(const ActivationCandidate& activation,
-                                  double squeeze,
-                                  SpPosition required_whammy_end) const
+ActResult ActEndSweep::check(PointPtr act_end)
+{
+    const auto result = check_act_end(act_end);
+#ifdef CHOPT_DETAILED_STATS
+    auto& counters = m_song->m_hot_path_counters;
+    switch (result.validity) {
+    case ActValidity::success:
+        counters.valid_acts.increment();
+        break;
+    case ActValidity::insufficient_sp:
+        counters.insufficient_sp_acts.increment();
+        break;
+    case ActValidity::surplus_sp:
+        counters.surplus_sp_acts.increment();
+        break;
+    }
+#endif
+    return result;
+}
+
+ActResult ActEndSweep::check_act_end(PointPtr act_end)
 {
     static constexpr double MEASURES_PER_BAR = 8.0;
     const SpPosition null_position {SightRead::Beat(0.0), SpMeasure(0.0)};
+    const auto& points = m_song->m_points;
+    const auto& sp_data = *m_song->m_sp_data;
+    const auto overlaps = m_song->m_overlaps;
 
-    if (!activation.sp_bar.full_enough_to_activate(m_minimum_sp_to_activate)) {
+    if (!m_can_activate) {
         return {null_position, ActValidity::insufficient_sp};
     }
 
-    auto ending_pos = adjusted_hit_window_start(activation.act_end, squeeze);
-    if (ending_pos.beat < activation.earliest_activation_point.beat) {
-        ending_pos = activation.earliest_activation_point;
+    auto ending_pos = m_song->adjusted_hit_window_start(act_end, m_squeeze);
+    if (ending_pos.beat < m_earliest_activation_point.beat) {
+        ending_pos = m_earliest_activation_point;
+    }
+    // Act ends normally only move forward, but start over if one does not.
+    if (act_end < m_commit_act_end || ending_pos.beat < m_commit_limit.beat) {
+        reset();
+    }
+    commit_sp_notes(act_end, ending_pos);
+    if (m_is_short_of_sp) {
+        return {null_position, ActValidity::insufficient_sp};
     }
 
-    auto late_end_position
-        = adjusted_hit_window_end(activation.act_start, squeeze);
+    auto status_for_early_end = m_early_end_status;
+    auto status_for_late_end = m_late_end_status;
     // This conditional can be taken if, for example, the first and last point
     // are the same.
-    if (late_end_position.beat > ending_pos.beat) {
-        late_end_position = ending_pos;
-    }
-    auto late_end_sp = activation.sp_bar.max();
-    late_end_sp
-        += m_sp_data.available_whammy(activation.earliest_activation_point.beat,
-                                      activation.act_start->position.beat);
-    late_end_sp = std::min(late_end_sp, 1.0);
-
-    SpStatus status_for_early_end {
-        activation.earliest_activation_point,
-        std::max(activation.sp_bar.min(), m_minimum_sp_to_activate),
-        m_overlaps};
-    SpStatus status_for_late_end {late_end_position, late_end_sp, m_overlaps};
-
-    for (auto p = m_points.next_sp_granting_note(activation.act_start);
-         p < activation.act_end;
-         p = m_points.next_sp_granting_note(std::next(p))) {
-        auto p_start = adjusted_hit_window_start(p, squeeze);
-        if (p_start.beat < activation.earliest_activation_point.beat) {
-            p_start = activation.earliest_activation_point;
-        }
-        auto p_end = adjusted_hit_window_end(p, squeeze);
-        if (p_end.beat > ending_pos.beat) {
-            p_end = ending_pos;
-        }
-        status_for_late_end.update_late_end(p_start, p_end, m_sp_data,
-                                            m_overlaps);
-        if (status_for_late_end.sp() < 0.0) {
+    if (m_late_end_start.beat > ending_pos.beat) {
+        status_for_late_end = {ending_pos, m_late_end_sp, overlaps};
+    }
+    for (auto p = m_next_sp_note; p < act_end;
+         p = points.next_sp_granting_note(std::next(p))) {
+        if (!add_sp_note(p, ending_pos, status_for_early_end,
+                         status_for_late_end)) {
             return {null_position, ActValidity::insufficient_sp};
         }
-        status_for_early_end.update_early_end(p_start, m_sp_data,
-                                              required_whammy_end);
-        if (m_overlaps) {
-            status_for_early_end.add_phrase();
-            status_for_late_end.add_phrase();
-            if (p->is_unison_sp_granting_note) {
-                status_for_early_end.add_phrase();
-                status_for_late_end.add_phrase();
-            }
-        }
     }
 
-    status_for_late_end.advance_whammy_max(ending_pos, m_sp_data, m_overlaps);
+    status_for_late_end.advance_whammy_max(ending_pos, sp_data, overlaps);
     if (status_for_late_end.sp() < 0.0) {
         return {null_position, ActValidity::insufficient_sp};
     }
 
-    status_for_early_end.update_early_end(ending_pos, m_sp_data,
-                                          required_whammy_end);
-    if (m_overlaps && activation.act_end->is_sp_granting_note) {
+    status_for_early_end.update_early_end(ending_pos, sp_data,
+                                          m_required_whammy_end);
+    if (overlaps && act_end->is_sp_granting_note) {
         status_for_early_end.add_phrase();
-        if (activation.act_end->is_unison_sp_granting_note) {
+        if (act_end->is_unison_sp_granting_note) {
             status_for_early_end.add_phrase();
         }
     }
     const auto end_meas = status_for_early_end.position().sp_measure
         + SpMeasure(status_for_early_end.sp() * MEASURES_PER_BAR);
 
-    const auto next_point = std::next(activation.act_end);
-    if (next_point != m_points.cend()
+    const auto next_point = std::next(act_end);
+    if (next_point != points.cend()
         && end_meas
-            >= adjusted_hit_window_end(next_point, squeeze).sp_measure) {
+            >= m_song->adjusted_hit_window_end(next_point, m_squeeze)
+                   .sp_measure) {
         return {null_position, ActValidity::surplus_sp};
     }
 
-    const auto end_beat = m_time_map.to_beats(end_meas);
+    const auto end_beat = m_song->m_time_map.to_beats(end_meas);
     return {{end_beat, end_meas}, ActValidity::success};
 }
 
+ActResult
+ProcessedSong::is_candidate_valid(const ActivationCandidate& activation,
+                                  double squeeze,
+                                  SpPosition required_whammy_end) const
+{
+    ActEndSweep sweep {*this,
+                       activation.act_start,
+                       activation.earliest_activation_point,
+                       activation.sp_bar,
+                       squeeze,
+                       required_whammy_end};
+    return sweep.check(activation.act_end);
+}
+
 void ProcessedSong::append_activation(std::stringstream& stream,
                                       const Activation& activation,
                                       const std::string& act_summary) const
@@ -500,6 +613,23 @@ ProcessedSong::drum_act_summaries(const Path& path) const
     return activation_summaries;
 }
 
+int ProcessedSong::no_sp_score() const
+{
+    const auto note_score = std::accumulate(
+        m_points.cbegin(), m_points.cend(), 0,
+        [](const auto x, const auto& y) { return x + y.value; });
+    return note_score + m_total_solo_boost + m_total_bre_boost;
+}
+
+std::string ProcessedSong::score_summary(const Path& path) const
+{
+    const auto no_sp = no_sp_score();
+    std::stringstream stream;
+    stream << "No SP score: " << no_sp
+           << "\nTotal score: " << no_sp + path.score_boost;
+    return stream.str();
+}
+
 std::string ProcessedSong::path_summary(const Path& path) const
 {
     constexpr double AVG_MULT_PRECISION = 1000.0;
@@ -520,15 +650,8 @@ std::string ProcessedSong::path_summary(const Path& path) const
         }
     }
 
-    auto no_sp_score = std::accumulate(
-        m_points.cbegin(), m_points.cend(), 0,
-        [](const auto x, const auto& y) { return x + y.value; });
-    no_sp_score += m_total_solo_boost;
-    no_sp_score += m_total_bre_boost;
-    stream << "\nNo SP score: " << no_sp_score;
-
-    const auto total_score = no_sp_score + path.score_boost;
-    stream << "\nTotal score: " << total_score;
+    const auto total_score = no_sp_score() + path.score_boost;
+    stream << '\n' << score_summary(path);
 
     if (!m_ignore_average_multiplier) {
         double avg_mult = 0;
@@ -0,0 +1,162 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <iterator>
+#include <typeinfo>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QString>
+
+#include "resultcache.hpp"
+
+namespace {
+// Bump CACHE_VERSION whenever the entry format changes.
+constexpr quint32 CACHE_MAGIC = 0x43484F50;
+constexpr quint32 CACHE_VERSION = 1;
+constexpr auto STREAM_VERSION = QDataStream::Qt_6_0;
+
+QString to_qstring(const std::filesystem::path& path)
+{
+    return QString::fromStdU16String(path.u16string());
+}
+}
+
+std::string result_cache_key(const std::string& content_hash,
+                             const Settings& settings)
+{
+    // Engines are only available through a pointer to their base class, so
+    // their dynamic type is what tells them apart. The application version is
+    // included so that entries from older versions of CHOpt are not used.
+    const Engine& engine = *settings.engine;
+    const auto& squeeze_settings = settings.squeeze_settings;
+    const auto& drum_settings = settings.drum_settings;
+
+    QByteArray data;
+    QDataStream stream {&data, QIODevice::WriteOnly};
+    stream.setVersion(STREAM_VERSION);
+    stream << CACHE_VERSION << QCoreApplication::applicationVersion()
+           << QString::fromStdString(content_hash)
+           << static_cast<qint32>(settings.game)
+           << QString::fromLatin1(typeid(engine).name())
+           << static_cast<qint32>(settings.instrument)
+           << static_cast<qint32>(settings.difficulty)
+           << squeeze_settings.squeeze << squeeze_settings.early_whammy
+           << squeeze_settings.lazy_whammy.value()
+           << squeeze_settings.video_lag.value()
+           << squeeze_settings.whammy_delay.value()
+           << drum_settings.enable_double_kick << drum_settings.disable_kick
+           << drum_settings.pro_drums << drum_settings.enable_dynamics
+           << static_cast<qint32>(settings.speed);
+
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256)
+        .toHex()
+        .toStdString();
+}
+
+ResultCache::ResultCache(const std::filesystem::path& directory,
+                         const std::string& key)
+    : m_file_path {directory / (key + ".chopt")}
+{
+}
+
+std::optional<CachedResult> ResultCache::load(const PointSet& points) const
+{
+    QFile file {to_qstring(m_file_path)};
+    if (!file.open(QIODevice::ReadOnly)) {
+        return std::nullopt;
+    }
+
+    QDataStream stream {&file};
+    stream.setVersion(STREAM_VERSION);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 point_count = 0;
+    qint32 score_boost = 0;
+    qint32 act_count = 0;
+    stream >> magic >> version >> point_count >> score_boost >> act_count;
+    if (stream.status() != QDataStream::Ok || magic != CACHE_MAGIC
+        || version != CACHE_VERSION
+        || point_count != std::distance(points.cbegin(), points.cend())
+        || act_count < 0) {
+        return std::nullopt;
+    }
+
+    CachedResult result;
+    result.path.score_boost = score_boost;
+    for (auto i = 0; i < act_count; ++i) {
+        qint64 act_start = 0;
+        qint64 act_end = 0;
+        double whammy_end = 0.0;
+        double sp_start = 0.0;
+        double sp_end = 0.0;
+        stream >> act_start >> act_end >> whammy_end >> sp_start >> sp_end;
+        if (stream.status() != QDataStream::Ok || act_start < 0
+            || act_start > act_end || act_end >= point_count) {
+            return std::nullopt;
+        }
+        result.path.activations.push_back(
+            {std::next(points.cbegin(), act_start),
+             std::next(points.cbegin(), act_end),
+             SightRead::Beat {whammy_end}, SightRead::Beat {sp_start},
+             SightRead::Beat {sp_end}});
+    }
+
+    QString path_summary;
+    stream >> path_summary;
+    if (stream.status() != QDataStream::Ok) {
+        return std::nullopt;
+    }
+    result.path_summary = path_summary.toStdString();
+    return result;
+}
+
+void ResultCache::store(const CachedResult& result,
+                        const PointSet& points) const
+{
+    if (!QDir().mkpath(to_qstring(m_file_path.parent_path()))) {
+        return;
+    }
+    // QSaveFile only replaces the entry once it is completely written, so
+    // another run reading the same entry never sees half of one.
+    QSaveFile file {to_qstring(m_file_path)};
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    const auto point_count = std::distance(points.cbegin(), points.cend());
+    QDataStream stream {&file};
+    stream.setVersion(STREAM_VERSION);
+    stream << CACHE_MAGIC << CACHE_VERSION << static_cast<qint64>(point_count)
+           << static_cast<qint32>(result.path.score_boost)
+           << static_cast<qint32>(result.path.activations.size());
+    for (const auto& act : result.path.activations) {
+        const auto act_start = std::distance(points.cbegin(), act.act_start);
+        const auto act_end = std::distance(points.cbegin(), act.act_end);
+        stream << static_cast<qint64>(act_start) << static_cast<qint64>(act_end)
+               << act.whammy_end.value() << act.sp_start.value()
+               << act.sp_end.value();
+    }
+    stream << QString::fromStdString(result.path_summary);
+    file.commit();
+}
@@ -16,6 +16,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 
@@ -110,6 +112,17 @@ Game game_from_string(std::string_view game)
     return game_map.at(game);
 }
 
+DpEngine string_to_dp_engine(std::string_view text)
+{
+    if (text == "recursive") {
+        return DpEngine::Recursive;
+    }
+    if (text == "iterative") {
+        return DpEngine::Iterative;
+    }
+    throw std::invalid_argument("Unrecognised DP engine");
+}
+
 std::unique_ptr<QCommandLineParser> arg_parser()
 {
     auto parser = std::make_unique<QCommandLineParser>();
@@ -139,6 +152,12 @@ std::unique_ptr<QCommandLineParser> arg_parser()
           "Squeeze% (0 to 100). Default 100.",
           "squeeze",
           "100"},
+         {"squeeze-sweep",
+          "Comma separated squeeze percentages to optimise at, writing one "
+          "image for each. Early whammy follows each level unless set with "
+          "--early-whammy. Cannot be used with --quick-path or "
+          "--result-cache.",
+          "squeeze-sweep"},
          {{"ew", "early-whammy"},
           "Early whammy% (0 to 100), <= squeeze, defaults to squeeze.",
           "early-whammy"},
@@ -157,6 +176,22 @@ std::unique_ptr<QCommandLineParser> arg_parser()
           "video-lag",
           "0"},
          {{"s", "speed"}, "Speed in %. Default 100.", "speed", "100"},
+         {{"j", "threads"},
+          "Number of threads the optimiser may use. Default 1.",
+          "threads",
+          "1"},
+         {"dp-engine",
+          "How the optimiser works through subproblems, options are "
+          "recursive, iterative. Default recursive.",
+          "dp-engine", "recursive"},
+         {"time-budget",
+          "Seconds the optimiser may search for. If they run out, the best "
+          "path found so far is given, which may not be optimal.",
+          "time-budget"},
+         {"memory-limit",
+          "Megabytes of memory the optimiser's cache may use. Over this, "
+          "results that can be worked out again are dropped.",
+          "memory-limit"},
          {{"l", "lefty-flip"}, "Draw with lefty flip."},
          {"no-double-kick", "Disable 2x kick for drum charts."},
          {"no-kick", "Disable single kicks for drum charts."},
@@ -173,7 +208,22 @@ std::unique_ptr<QCommandLineParser> arg_parser()
          {"no-time-sigs", "Do not draw time signatures."},
          {"act-opacity",
           "Opacity of drawn activations (0.0 to 1.0). Default 0.33.",
-          "act-opacity", "0.33"}});
+          "act-opacity", "0.33"},
+         {"stats", "Print statistics about the optimiser's search."},
+         {"quick-path",
+          "Print a path found quickly, which may not be optimal, before "
+          "optimising."},
+         {"score-only",
+          "Only print the optimal score, without finding the path itself. "
+          "No image is created."},
+         {"result-cache",
+          "Directory to cache optimised paths in, so that running again "
+          "with the same song and settings skips optimisation.",
+          "result-cache"},
+         {"checkpoint-dir",
+          "Directory to save the optimiser's progress in if it is cancelled "
+          "or runs out of time, so that running again carries on from there.",
+          "checkpoint-dir"}});
     return parser;
 }
 }
@@ -221,6 +271,7 @@ game_to_engine(Game game, SightRead::Instrument instrument, bool precision_mode)
 
 Settings from_args(const QStringList& args)
 {
+    constexpr std::size_t BYTES_PER_MEGABYTE = 1024 * 1024;
     constexpr int MAX_PERCENT = 100;
     constexpr int MAX_SPEED = 5000;
     constexpr int MAX_VIDEO_LAG = 200;
@@ -293,8 +344,34 @@ Settings from_args(const QStringList& args)
             "Whammy delay must be greater than or equal to 0");
     }
 
+    const auto squeeze_sweep = parser->value("squeeze-sweep");
+    if (!squeeze_sweep.isEmpty()) {
+        for (const auto& level : squeeze_sweep.split(',')) {
+            auto ok = false;
+            const auto level_squeeze = level.trimmed().toInt(&ok);
+            if (!ok || level_squeeze < 0 || level_squeeze > MAX_PERCENT) {
+                throw std::invalid_argument(
+                    "Squeeze sweep levels must lie between 0 and 100");
+            }
+            settings.squeeze_sweep.push_back(level_squeeze);
+        }
+        if (settings.blank) {
+            throw std::invalid_argument(
+                "Squeeze sweep cannot be used with a blank image");
+        }
+        if (parser->isSet("quick-path")) {
+            throw std::invalid_argument(
+                "Squeeze sweep cannot be used with a quick path");
+        }
+        if (parser->isSet("result-cache")) {
+            throw std::invalid_argument(
+                "Squeeze sweep cannot be used with a result cache");
+        }
+    }
+
     settings.squeeze_settings.squeeze = squeeze / 100.0;
     settings.squeeze_settings.early_whammy = early_whammy / 100.0;
+    settings.early_whammy_follows_squeeze = !parser->isSet("early-whammy");
     settings.squeeze_settings.lazy_whammy
         = SightRead::Second {lazy_whammy / MS_PER_SECOND};
     settings.squeeze_settings.whammy_delay
@@ -316,6 +393,36 @@ Settings from_args(const QStringList& args)
 
     settings.speed = speed;
 
+    const auto threads = parser->value("threads").toInt();
+    if (threads < 1) {
+        throw std::invalid_argument("Thread count must be at least 1");
+    }
+
+    settings.optimiser_settings.threads = threads;
+    settings.optimiser_settings.dp_engine
+        = string_to_dp_engine(parser->value("dp-engine").toStdString());
+
+    if (parser->isSet("time-budget")) {
+        auto ok = false;
+        const auto time_budget = parser->value("time-budget").toDouble(&ok);
+        if (!ok || time_budget <= 0.0) {
+            throw std::invalid_argument("Time budget must be positive");
+        }
+        settings.optimiser_settings.time_budget
+            = std::chrono::milliseconds {
+                std::llround(time_budget * MS_PER_SECOND)};
+    }
+
+    if (parser->isSet("memory-limit")) {
+        auto ok = false;
+        const auto memory_limit = parser->value("memory-limit").toUInt(&ok);
+        if (!ok || memory_limit == 0) {
+            throw std::invalid_argument("Memory limit must be positive");
+        }
+        settings.optimiser_settings.memory_limit
+            = static_cast<std::size_t>(memory_limit) * BYTES_PER_MEGABYTE;
+    }
+
     const auto opacity = parser->value("act-opacity").toFloat();
     if (opacity < 0.0F || opacity > 1.0F) {
         throw std::invalid_argument(
@@ -323,6 +430,22 @@ Settings from_args(const QStringList& args)
     }
 
     settings.opacity = opacity;
+    settings.print_stats = parser->isSet("stats");
+    settings.print_quick_path = parser->isSet("quick-path");
+    settings.optimiser_settings.score_only = parser->isSet("score-only");
+    if (settings.optimiser_settings.score_only) {
+        if (settings.blank) {
+            throw std::invalid_argument(
+                "Score only mode cannot be used with a blank image");
+        }
+        if (!settings.squeeze_sweep.empty()) {
+            throw std::invalid_argument(
+                "Score only mode cannot be used with a squeeze sweep");
+        }
+        settings.draw_image = false;
+    }
+    settings.result_cache_dir = parser->value("result-cache").toStdString();
+    settings.checkpoint_dir = parser->value("checkpoint-dir").toStdString();
 
     return settings;
 }
@@ -20,6 +20,8 @@
 #include <set>
 #include <string_view>
 
+#include <QByteArray>
+#include <QCryptographicHash>
 #include <QFile>
 #include <QString>
 
@@ -97,6 +99,16 @@ SongFile::SongFile(const std::string& filename)
     const auto chart_buffer = chart.readAll();
     m_loaded_file = std::vector<std::uint8_t> {chart_buffer.cbegin(),
                                                chart_buffer.cend()};
+
+    // The ini's length goes in first so that no two different pairs of files
+    // hash the same data.
+    const auto ini_buffer = QByteArray::fromStdString(ini_file);
+    QCryptographicHash hash {QCryptographicHash::Sha256};
+    hash.addData(QByteArray::number(static_cast<int>(m_file_type)));
+    hash.addData(QByteArray::number(ini_buffer.size()));
+    hash.addData(ini_buffer);
+    hash.addData(chart_buffer);
+    m_content_hash = hash.result().toHex().toStdString();
 }
 
 SightRead::Song SongFile::load_song(Game game) const
@@ -61,13 +61,13 @@ note_spans(const SightRead::NoteTrack& track, double early_whammy,
             late_gap = tempo_map.to_seconds(std::next(note)->position).value()
                 - current_note_time;
         }
+        const auto early_window
+            = SightRead::Second {engine.early_timing_window(early_gap,
+                                                            late_gap)}
+            * early_whammy;
         for (auto length : note->lengths) {
             if (length != SightRead::Tick {-1}) {
-                spans.emplace_back(
-                    note->position, length,
-                    SightRead::Second {
-                        engine.early_timing_window(early_gap, late_gap)}
-                        * early_whammy);
+                spans.emplace_back(note->position, length, early_window);
             }
         }
     }
@@ -307,6 +307,22 @@ bool SpData::is_in_whammy_ranges(SightRead::Beat beat) const
     return p->start.beat <= beat;
 }
 
+SpPosition SpData::whammy_equivalent_position(SpPosition pos) const
+{
+    const auto p = first_whammy_range_after(pos.beat);
+    if (p == m_whammy_ranges.cend()) {
+        if (m_whammy_ranges.empty()) {
+            return {SightRead::Beat {-std::numeric_limits<double>::infinity()},
+                    SpMeasure {-std::numeric_limits<double>::infinity()}};
+        }
+        return m_whammy_ranges.back().end;
+    }
+    if (p->start.beat < pos.beat) {
+        return pos;
+    }
+    return p->start;
+}
+
 double SpData::available_whammy(SightRead::Beat start,
                                 SightRead::Beat end) const
 {
@@ -0,0 +1,184 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <utility>
+
+#include "threadpool.hpp"
+
+namespace {
+// The pool and queue of the worker the current thread belongs to, if any.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local std::size_t current_queue_index = 0;
+
+// Waiting on a group helps with other tasks, which may themselves wait and
+// help. Past this depth the thread stops stealing and only runs tasks from its
+// own queue, so a long chain of waits cannot overflow the stack.
+constexpr int MAX_HELP_DEPTH = 64;
+thread_local int current_help_depth = 0;
+}
+
+ThreadPool::ThreadPool(int thread_count)
+{
+    if (thread_count < 1) {
+        throw std::invalid_argument("Thread pool must have at least 1 thread");
+    }
+    const auto queue_count = static_cast<std::size_t>(thread_count);
+    m_queues.reserve(queue_count);
+    for (auto i = 0U; i < queue_count; ++i) {
+        m_queues.push_back(std::make_unique<TaskQueue>());
+    }
+    m_workers.reserve(queue_count - 1);
+    for (auto i = 0U; i < queue_count - 1; ++i) {
+        m_workers.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock {m_wake_mutex};
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+// Threads that are not workers of this pool all share the last queue.
+std::size_t ThreadPool::own_queue_index() const
+{
+    if (current_pool == this) {
+        return current_queue_index;
+    }
+    return m_queues.size() - 1;
+}
+
+void ThreadPool::push(Task task)
+{
+    auto& queue = *m_queues[own_queue_index()];
+    {
+        std::lock_guard lock {queue.mutex};
+        queue.tasks.push_back(std::move(task));
+    }
+    ++m_queued_tasks;
+    m_wake.notify_one();
+    wake_parked_helpers();
+}
+
+bool ThreadPool::try_run_task(bool allow_stealing)
+{
+    const auto own_index = own_queue_index();
+    const auto queue_count = allow_stealing ? m_queues.size() : 1;
+    Task task;
+    for (auto i = 0U; i < queue_count && !task; ++i) {
+        const auto index = (own_index + i) % m_queues.size();
+        auto& queue = *m_queues[index];
+        std::lock_guard lock {queue.mutex};
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (index == own_index) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --m_queued_tasks;
+    task();
+    wake_parked_helpers();
+    return true;
+}
+
+void ThreadPool::wake_parked_helpers()
+{
+    if (m_parked_helpers == 0) {
+        return;
+    }
+    // A helper checks what it waits on while holding the mutex, so taking it
+    // here means the helper is either asleep or will see the change.
+    {
+        std::lock_guard lock {m_wake_mutex};
+    }
+    m_progress.notify_all();
+}
+
+void ThreadPool::worker_loop(std::size_t index)
+{
+    current_pool = this;
+    current_queue_index = index;
+    while (!m_stopping) {
+        if (try_run_task(true)) {
+            continue;
+        }
+        std::unique_lock lock {m_wake_mutex};
+        m_wake.wait_for(lock, IDLE_WAIT,
+                        [&] { return m_stopping || m_queued_tasks > 0; });
+    }
+}
+
+ThreadPool::TaskGroup::~TaskGroup()
+{
+    // Queued tasks refer to this group, so they must finish before it goes
+    // away even if wait was never reached.
+    help_until_done();
+}
+
+void ThreadPool::TaskGroup::run(std::function<void()> task)
+{
+    ++m_pending_tasks;
+    m_pool.push([this, task = std::move(task)] {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard lock {m_error_mutex};
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+        --m_pending_tasks;
+    });
+}
+
+void ThreadPool::TaskGroup::help_until_done()
+{
+    ++current_help_depth;
+    while (m_pending_tasks > 0) {
+        const auto allow_stealing = current_help_depth <= MAX_HELP_DEPTH;
+        if (!m_pool.try_run_task(allow_stealing)) {
+            m_pool.park_until([&] { return m_pending_tasks == 0; },
+                              allow_stealing);
+        }
+    }
+    --current_help_depth;
+}
+
+void ThreadPool::TaskGroup::wait()
+{
+    help_until_done();
+    std::lock_guard lock {m_error_mutex};
+    if (m_error) {
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+}
@@ -20,6 +20,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include "optimiser.hpp"
 #include "test_helpers.hpp"
 
 namespace boost::test_tools::tt_detail {
@@ -1612,3 +1613,77 @@ BOOST_AUTO_TEST_CASE(nearly_overlapped_phrases_are_handled_correctly)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(squeeze_sweeps)
+
+BOOST_AUTO_TEST_CASE(sweep_levels_match_single_squeeze_runs)
+{
+    const auto sweep_settings = from_args(
+        {"chopt", "-f", "song.chart", "--squeeze-sweep", "20,100"});
+    const auto single_settings
+        = from_args({"chopt", "-f", "song.chart", "--squeeze", "20"});
+    const auto level_settings
+        = sweep_level_squeeze_settings(sweep_settings, 20);
+
+    BOOST_CHECK_EQUAL(level_settings.squeeze,
+                      single_settings.squeeze_settings.squeeze);
+    BOOST_CHECK_EQUAL(level_settings.early_whammy,
+                      single_settings.squeeze_settings.early_whammy);
+
+    SightRead::NoteTrack track {
+        {make_note(0), make_note(192), make_note(768), make_note(3840, 1420),
+         make_note(5376), make_note(13056), make_note(13248), make_note(13440),
+         make_note(13632), make_note(13824), make_note(14016),
+         make_note(14208)},
+        {{SightRead::Tick {0}, SightRead::Tick {1}},
+         {SightRead::Tick {192}, SightRead::Tick {1}},
+         {SightRead::Tick {3840}, SightRead::Tick {1728}}},
+        SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    const SpTimeMap time_map {{}, SpMode::Measure};
+    // make_sweep_builders builds SpData for a level like this.
+    const auto sp_data = std::make_shared<const SpData>(
+        track, time_map, std::vector<SightRead::Tick> {}, level_settings,
+        ChGuitarEngine());
+    const ProcessedSong level_track {
+        track,
+        time_map,
+        sp_data,
+        level_settings,
+        SightRead::DrumSettings::default_settings(),
+        ChGuitarEngine(),
+        {}};
+    const ProcessedSong single_track {
+        track,
+        time_map,
+        single_settings.squeeze_settings,
+        SightRead::DrumSettings::default_settings(),
+        ChGuitarEngine(),
+        {},
+        {}};
+    const std::atomic<bool> terminate {false};
+    const Optimiser level_optimiser {&level_track, &terminate, 100,
+                                     SightRead::Second(0.0)};
+    const Optimiser single_optimiser {&single_track, &terminate, 100,
+                                      SightRead::Second(0.0)};
+    const auto level_path = level_optimiser.optimal_path();
+    const auto single_path = single_optimiser.optimal_path();
+
+    BOOST_CHECK_EQUAL(level_path.score_boost, single_path.score_boost);
+    BOOST_CHECK_EQUAL(level_track.path_summary(level_path),
+                      single_track.path_summary(single_path));
+}
+
+BOOST_AUTO_TEST_CASE(set_early_whammy_is_kept_for_every_sweep_level)
+{
+    const auto settings
+        = from_args({"chopt", "-f", "song.chart", "--squeeze-sweep", "20,100",
+                     "--early-whammy", "50"});
+
+    BOOST_CHECK_EQUAL(sweep_level_squeeze_settings(settings, 20).early_whammy,
+                      0.5);
+    BOOST_CHECK_EQUAL(sweep_level_squeeze_settings(settings, 100).early_whammy,
+                      0.5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,8 +17,13 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iterator>
+#include <memory>
+#include <stdexcept>
 
 #include <boost/test/unit_test.hpp>
 
@@ -27,6 +32,228 @@
 
 namespace {
 const std::atomic<bool> term_bool {false};
+
+// The charts the optimiser's search settings are checked on. None of those
+// settings should change the path found, so the tests compare against a run
+// with the default settings rather than a known path.
+enum class TestChart {
+    Taps,
+    SpSustain,
+    Whammy,
+    DrumFills,
+    SustainAfterSpNote,
+    SqueezeTies,
+    BankedSpCostsAnActivation
+};
+
+constexpr std::array<TestChart, 7> TEST_CHARTS {
+    TestChart::Taps, TestChart::SpSustain, TestChart::Whammy,
+    TestChart::DrumFills, TestChart::SustainAfterSpNote,
+    TestChart::SqueezeTies, TestChart::BankedSpCostsAnActivation};
+
+std::ostream& operator<<(std::ostream& stream, TestChart chart)
+{
+    constexpr std::array<const char*, 7> NAMES {
+        "Taps", "SpSustain", "Whammy", "DrumFills", "SustainAfterSpNote",
+        "SqueezeTies", "BankedSpCostsAnActivation"};
+    stream << NAMES.at(static_cast<std::size_t>(chart));
+    return stream;
+}
+
+SightRead::NoteTrack make_test_note_track(TestChart chart)
+{
+    std::vector<SightRead::Note> notes;
+    std::vector<SightRead::StarPower> phrases;
+    auto track_type = SightRead::TrackType::FiveFret;
+    switch (chart) {
+    case TestChart::Taps:
+        // The optimal path is two activations for 150.
+        notes = {make_note(0),     make_note(192),   make_note(384),
+                 make_note(3224),  make_note(9378),  make_note(15714),
+                 make_note(15715)};
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {50}},
+                   {SightRead::Tick {192}, SightRead::Tick {50}},
+                   {SightRead::Tick {3224}, SightRead::Tick {50}},
+                   {SightRead::Tick {9378}, SightRead::Tick {50}}};
+        break;
+    case TestChart::SpSustain:
+        notes = {make_note(0),          make_note(192),   make_note(384),
+                 make_note(3234, 1440), make_note(10944), make_note(10945),
+                 make_note(10946),      make_note(10947), make_note(10948),
+                 make_note(10949),      make_note(10950), make_note(10951),
+                 make_note(10952),      make_note(10953)};
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {50}},
+                   {SightRead::Tick {192}, SightRead::Tick {50}},
+                   {SightRead::Tick {3234}, SightRead::Tick {50}}};
+        break;
+    case TestChart::Whammy:
+        notes = {make_note(0),          make_note(192),   make_note(768),
+                 make_note(3840, 1420), make_note(5376),  make_note(13056),
+                 make_note(13248),      make_note(13440), make_note(13632),
+                 make_note(13824),      make_note(14016), make_note(14208)};
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {1}},
+                   {SightRead::Tick {192}, SightRead::Tick {1}},
+                   {SightRead::Tick {3840}, SightRead::Tick {1728}}};
+        break;
+    case TestChart::DrumFills:
+        notes = {make_drum_note(0),     make_drum_note(192),
+                 make_drum_note(3840),  make_drum_note(3940),
+                 make_drum_note(4040),  make_drum_note(17000),
+                 make_drum_note(20000), make_drum_note(20100)};
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {1}},
+                   {SightRead::Tick {192}, SightRead::Tick {1}},
+                   {SightRead::Tick {4040}, SightRead::Tick {1}},
+                   {SightRead::Tick {17000}, SightRead::Tick {1}}};
+        track_type = SightRead::TrackType::Drums;
+        break;
+    case TestChart::SustainAfterSpNote:
+        // The first tick of the sustain comes straight after an SP granting
+        // note, so its previous point is not a sustain tick.
+        notes = {make_note(0),          make_note(192),  make_note(384),
+                 make_note(480, 1536),  make_note(3840), make_note(4032),
+                 make_note(4224, 768),  make_note(7680), make_note(7872),
+                 make_note(8064)};
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {1}},
+                   {SightRead::Tick {192}, SightRead::Tick {1}},
+                   {SightRead::Tick {384}, SightRead::Tick {1}},
+                   {SightRead::Tick {4032}, SightRead::Tick {1}}};
+        break;
+    case TestChart::SqueezeTies: {
+        // Enough notes to reach the top multiplier, half a bar of SP, then
+        // pairs of notes spaced about one activation apart. Every pair is
+        // worth the same, but they need different amounts of squeeze to get
+        // both notes, and only the second pair needs none.
+        constexpr std::array<int, 10> EXTRA_GAPS {36, -8, 28, 20, 12,
+                                                  32, 24, 16, 8, 4};
+        constexpr int FILLER_NOTES = 28;
+        constexpr int FILLER_SPACING = 48;
+        constexpr int ACT_LENGTH = 3072;
+        constexpr int PAIR_SPACING = 9600;
+        for (auto i = 0; i < FILLER_NOTES; ++i) {
+            notes.push_back(make_note(i * FILLER_SPACING));
+        }
+        notes.push_back(make_note(1536));
+        notes.push_back(make_note(1728));
+        phrases = {{SightRead::Tick {1536}, SightRead::Tick {1}},
+                   {SightRead::Tick {1728}, SightRead::Tick {1}}};
+        auto pair_start = 3840;
+        for (auto extra_gap : EXTRA_GAPS) {
+            notes.push_back(make_note(pair_start));
+            notes.push_back(make_note(pair_start + ACT_LENGTH + extra_gap));
+            pair_start += PAIR_SPACING;
+        }
+        break;
+    }
+    case TestChart::BankedSpCostsAnActivation: {
+        // The best path activates over the first run, so the SP note after it
+        // is banked. That leaves three quarters of a bar for the second run,
+        // which then takes in the SP notes meant for the third, so only one
+        // more run can be activated over. The segment starting after the long
+        // gap does not have that SP note, so it gets both runs and scores more
+        // than the key just before it.
+        constexpr std::array<int, 5> SP_NOTES {6912, 13824, 14016, 17472,
+                                               17664};
+        constexpr int FIRST_RUN = 768;
+        constexpr int SECOND_RUN = 14208;
+        constexpr int THIRD_RUN = 25344;
+        constexpr int RUN_NOTES = 17;
+        notes = {make_note(0), make_note(192)};
+        for (auto i = 0; i < 2 * RUN_NOTES - 1; ++i) {
+            notes.push_back(make_note(FIRST_RUN + 96 * i));
+        }
+        notes.push_back(make_note(SP_NOTES[0]));
+        notes.push_back(make_note(SP_NOTES[1]));
+        notes.push_back(make_note(SP_NOTES[2]));
+        for (auto i = 0; i < RUN_NOTES; ++i) {
+            notes.push_back(make_note(SECOND_RUN + 192 * i));
+        }
+        notes.push_back(make_note(SP_NOTES[3]));
+        notes.push_back(make_note(SP_NOTES[4]));
+        for (auto i = 0; i < RUN_NOTES; ++i) {
+            notes.push_back(make_note(THIRD_RUN + 192 * i));
+        }
+        phrases = {{SightRead::Tick {0}, SightRead::Tick {1}},
+                   {SightRead::Tick {192}, SightRead::Tick {1}}};
+        for (auto position : SP_NOTES) {
+            phrases.push_back({SightRead::Tick {position}, SightRead::Tick {1}});
+        }
+        break;
+    }
+    }
+    SightRead::NoteTrack note_track {
+        notes, phrases, track_type,
+        std::make_shared<SightRead::SongGlobalData>()};
+    if (chart == TestChart::DrumFills) {
+        std::vector<SightRead::DrumFill> fills {
+            {SightRead::Tick {3830}, SightRead::Tick {20}},
+            {SightRead::Tick {19990}, SightRead::Tick {20}}};
+        note_track.drum_fills(fills);
+    }
+    return note_track;
+}
+
+ProcessedSong make_test_song(TestChart chart)
+{
+    const auto note_track = make_test_note_track(chart);
+    if (chart == TestChart::DrumFills) {
+        return ProcessedSong {note_track,
+                              {{}, SpMode::Measure},
+                              SqueezeSettings::default_settings(),
+                              SightRead::DrumSettings::default_settings(),
+                              ChDrumEngine(),
+                              {},
+                              {}};
+    }
+    return ProcessedSong {note_track,
+                          {{}, SpMode::Measure},
+                          SqueezeSettings::default_settings(),
+                          SightRead::DrumSettings::default_settings(),
+                          ChGuitarEngine(),
+                          {},
+                          {}};
+}
+
+// A chart long enough that the prefetcher fills up and the search runs on
+// well past what it has waiting: a note every beat, nudged off the grid, with
+// two SP phrases in every 24 notes.
+ProcessedSong make_long_test_song(int note_count)
+{
+    constexpr int NOTES_PER_PHRASE_PAIR = 24;
+    constexpr int SECOND_PHRASE_OFFSET = 5;
+    std::vector<SightRead::Note> notes;
+    std::vector<SightRead::StarPower> phrases;
+    for (auto i = 0; i < note_count; ++i) {
+        const auto position = 192 * i + (i * 37) % 61;
+        notes.push_back(make_note(position));
+        if (i % NOTES_PER_PHRASE_PAIR == 0
+            || i % NOTES_PER_PHRASE_PAIR == SECOND_PHRASE_OFFSET) {
+            phrases.push_back(
+                {SightRead::Tick {position}, SightRead::Tick {1}});
+        }
+    }
+    const SightRead::NoteTrack note_track {
+        notes, phrases, SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    return ProcessedSong {note_track,
+                          {{}, SpMode::Measure},
+                          SqueezeSettings::default_settings(),
+                          SightRead::DrumSettings::default_settings(),
+                          ChGuitarEngine(),
+                          {},
+                          {}};
+}
+
+// Checks path is the path a run with the default settings finds.
+void check_default_path(const ProcessedSong& track, const Path& path)
+{
+    const Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0)};
+    const auto expected_path = optimiser.optimal_path();
+
+    BOOST_CHECK_EQUAL(path.score_boost, expected_path.score_boost);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+        path.activations.cbegin(), path.activations.cend(),
+        expected_path.activations.cbegin(), expected_path.activations.cend());
+}
 }
 
 BOOST_AUTO_TEST_SUITE(overlap_guitar_paths)
@@ -950,3 +1177,403 @@ BOOST_AUTO_TEST_CASE(quarter_bar_activations_are_possible_on_fortnite_engine)
                                   opt_path.activations.cend(),
                                   optimal_acts.cbegin(), optimal_acts.cend());
 }
+
+BOOST_AUTO_TEST_SUITE(multithreaded_paths)
+
+BOOST_AUTO_TEST_CASE(multithreaded_optimiser_finds_the_same_path)
+{
+    const auto track = make_test_song(TestChart::Taps);
+    OptimiserSettings settings;
+    settings.threads = 4;
+    Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0),
+                         settings};
+    const auto& points = track.points();
+    std::vector<Activation> optimal_acts {
+        {points.cbegin() + 2, points.cbegin() + 2, SightRead::Beat {0.0},
+         SightRead::Beat {0.8958}, SightRead::Beat {16.8958}},
+        {points.cbegin() + 5, points.cbegin() + 6, SightRead::Beat {0.0},
+         SightRead::Beat {81.84375}, SightRead::Beat {97.84375}}};
+    const auto opt_path = optimiser.optimal_path();
+
+    BOOST_CHECK_EQUAL(opt_path.score_boost, 150);
+    BOOST_CHECK_EQUAL_COLLECTIONS(opt_path.activations.cbegin(),
+                                  opt_path.activations.cend(),
+                                  optimal_acts.cbegin(), optimal_acts.cend());
+}
+
+BOOST_AUTO_TEST_CASE(multithreaded_optimiser_matches_serial)
+{
+    OptimiserSettings settings;
+    settings.threads = 3;
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            check_default_path(track, optimiser.optimal_path());
+        }
+    }
+}
+
+// Once the prefetcher has as much waiting as it is allowed, it has to hand
+// back what the search went past rather than stop for the rest of the song.
+BOOST_AUTO_TEST_CASE(prefetcher_keeps_going_after_reaching_its_limit)
+{
+    constexpr int NOTE_COUNT = 20000;
+    const auto track = make_long_test_song(NOTE_COUNT);
+    OptimiserSettings settings;
+    settings.threads = 4;
+    settings.memory_limit = 20000;
+    const Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0),
+                               settings};
+    SearchStats stats;
+
+    check_default_path(track, optimiser.optimal_path(&stats));
+    BOOST_CHECK_GT(stats.prefetched_lists_evicted, 0U);
+    BOOST_CHECK_GT(stats.prefetched_lists_taken, 0U);
+}
+
+// With threads every tie gets a full squeeze search, while one thread skips
+// the ties that cannot need less squeeze than the best so far. Both must pick
+// the same tie with the same squeeze.
+BOOST_AUTO_TEST_CASE(skipping_ties_gives_the_same_squeeze)
+{
+    const auto track = make_test_song(TestChart::SqueezeTies);
+    OptimiserSettings settings;
+    settings.threads = 3;
+    const Optimiser serial_optimiser {&track, &term_bool, 100,
+                                      SightRead::Second(0.0)};
+    const Optimiser threaded_optimiser {&track, &term_bool, 100,
+                                        SightRead::Second(0.0), settings};
+    SearchStats serial_stats;
+    SearchStats threaded_stats;
+    const auto serial_path = serial_optimiser.optimal_path(&serial_stats);
+    const auto threaded_path
+        = threaded_optimiser.optimal_path(&threaded_stats);
+
+    BOOST_CHECK_EQUAL(serial_path.score_boost, 400);
+    BOOST_REQUIRE_EQUAL(serial_path.activations.size(), 1U);
+    BOOST_CHECK_EQUAL(
+        serial_path.activations[0].act_start->position.beat.value(), 70.0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+        serial_path.activations.cbegin(), serial_path.activations.cend(),
+        threaded_path.activations.cbegin(), threaded_path.activations.cend());
+#ifdef CHOPT_DETAILED_STATS
+    BOOST_CHECK_LT(serial_stats.reconstruction_acts_checked,
+                   threaded_stats.reconstruction_acts_checked);
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(iterative_engine_matches_recursive_engine)
+{
+    OptimiserSettings settings;
+    settings.dp_engine = DpEngine::Iterative;
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            check_default_path(track, optimiser.optimal_path());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(search_stats_are_filled_in)
+{
+    const auto track = make_test_song(TestChart::Taps);
+    Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0)};
+    SearchStats stats;
+    const auto opt_path = optimiser.optimal_path(&stats);
+
+    BOOST_CHECK_EQUAL(opt_path.score_boost, 150);
+    BOOST_CHECK_GT(stats.subproblems_solved, 0U);
+    BOOST_CHECK_GT(stats.candidates_scored, 0U);
+#ifdef CHOPT_DETAILED_STATS
+    BOOST_CHECK_GT(stats.path_cache_misses, 0U);
+    BOOST_CHECK_GT(stats.valid_acts, 0U);
+    BOOST_CHECK_GT(stats.whammy_queries, 0U);
+#endif
+}
+
+// path_score_upper_bound once capped a key by the cached score of the key
+// before it even across an SP granting note, which could prune the optimal
+// path.
+BOOST_AUTO_TEST_CASE(pruning_does_not_change_the_path)
+{
+    OptimiserSettings settings;
+    settings.prune_candidates = false;
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser unpruned_optimiser {
+                &track, &term_bool, 100, SightRead::Second(0.0), settings};
+            SearchStats stats;
+            check_default_path(track, unpruned_optimiser.optimal_path(&stats));
+            BOOST_CHECK_EQUAL(stats.candidates_pruned, 0U);
+        }
+    }
+}
+
+// path_score_lower_bound once took the score of the first key at the next
+// point as a lower bound. Banking an SP note can leave a key worse off than the
+// key after it, so every candidate of the optimal path's key was pruned.
+BOOST_AUTO_TEST_CASE(keys_at_the_next_point_do_not_bound_scores_from_below)
+{
+    const auto track = make_test_song(TestChart::BankedSpCostsAnActivation);
+    OptimiserSettings unpruned_settings;
+    unpruned_settings.prune_candidates = false;
+    const Optimiser unpruned_optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0),
+                                       unpruned_settings};
+    const auto expected_path = unpruned_optimiser.optimal_path();
+
+    for (auto engine : {DpEngine::Recursive, DpEngine::Iterative}) {
+        OptimiserSettings settings;
+        settings.dp_engine = engine;
+        const Optimiser optimiser {&track, &term_bool, 100,
+                                   SightRead::Second(0.0), settings};
+        const auto path = optimiser.optimal_path();
+
+        BOOST_CHECK_EQUAL(path.score_boost, expected_path.score_boost);
+        BOOST_CHECK_EQUAL_COLLECTIONS(
+            path.activations.cbegin(), path.activations.cend(),
+            expected_path.activations.cbegin(),
+            expected_path.activations.cend());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(long_gaps_split_the_song_into_segments)
+{
+    std::vector<SightRead::Note> notes {
+        make_note(0),     make_note(192),   make_note(384),
+        make_note(10000), make_note(10192), make_note(10384)};
+    std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {0}, SightRead::Tick {50}},
+        {SightRead::Tick {192}, SightRead::Tick {50}},
+        {SightRead::Tick {10000}, SightRead::Tick {50}},
+        {SightRead::Tick {10192}, SightRead::Tick {50}}};
+    SightRead::NoteTrack note_track {
+        notes, phrases, SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    ProcessedSong track {note_track,
+                         {{}, SpMode::Measure},
+                         SqueezeSettings::default_settings(),
+                         SightRead::DrumSettings::default_settings(),
+                         ChGuitarEngine(),
+                         {},
+                         {}};
+    const auto& points = track.points();
+    Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0)};
+    SearchStats stats;
+    const auto opt_path = optimiser.optimal_path(&stats);
+
+    BOOST_CHECK_EQUAL(stats.song_segments, 2U);
+    // SP saved before the gap is still spent after it.
+    BOOST_CHECK_EQUAL(opt_path.score_boost, 150);
+    BOOST_REQUIRE_EQUAL(opt_path.activations.size(), 1U);
+    BOOST_CHECK(opt_path.activations[0].act_start == points.cbegin() + 3);
+    BOOST_CHECK(opt_path.activations[0].act_end == points.cbegin() + 5);
+}
+
+BOOST_AUTO_TEST_CASE(memory_limit_does_not_change_the_path)
+{
+    OptimiserSettings settings;
+    settings.memory_limit = 0;
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            SearchStats stats;
+            check_default_path(track, optimiser.optimal_path(&stats));
+            BOOST_CHECK_GT(stats.peak_cache_bytes, 0U);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(memory_limit_drops_tie_lists)
+{
+    const auto track = make_test_song(TestChart::Taps);
+    OptimiserSettings settings;
+    settings.memory_limit = 0;
+    const Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0),
+                               settings};
+    SearchStats stats;
+    const auto opt_path = optimiser.optimal_path(&stats);
+
+    BOOST_CHECK_EQUAL(opt_path.score_boost, 150);
+    BOOST_CHECK_GT(stats.tie_lists_dropped, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(greedy_path_is_flagged_and_no_better_than_optimal)
+{
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0)};
+            const auto greedy_path = optimiser.greedy_path();
+            const auto opt_path = optimiser.optimal_path();
+
+            BOOST_CHECK(greedy_path.is_possibly_suboptimal);
+            BOOST_CHECK(!greedy_path.activations.empty());
+            BOOST_CHECK_GT(greedy_path.score_boost, 0);
+            BOOST_CHECK_LE(greedy_path.score_boost, opt_path.score_boost);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(optimal_path_hands_over_the_greedy_path_it_starts_from)
+{
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0)};
+            const auto greedy_path = optimiser.greedy_path();
+            std::vector<Path> handed_over_paths;
+
+            const auto opt_path = optimiser.optimal_path(
+                nullptr,
+                [&](const Path& path) { handed_over_paths.push_back(path); });
+
+            BOOST_REQUIRE_EQUAL(handed_over_paths.size(), 1U);
+            const auto& handed_over_path = handed_over_paths.front();
+            BOOST_CHECK(handed_over_path.is_possibly_suboptimal);
+            BOOST_CHECK_EQUAL(handed_over_path.score_boost,
+                              greedy_path.score_boost);
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                handed_over_path.activations.cbegin(),
+                handed_over_path.activations.cend(),
+                greedy_path.activations.cbegin(),
+                greedy_path.activations.cend());
+            BOOST_CHECK_EQUAL(opt_path.score_boost,
+                              optimiser.optimal_path().score_boost);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(score_only_mode_gives_the_same_score)
+{
+    OptimiserSettings settings;
+    settings.score_only = true;
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0)};
+            const Optimiser score_optimiser {&track, &term_bool, 100,
+                                             SightRead::Second(0.0), settings};
+            const auto opt_path = optimiser.optimal_path();
+            const auto score_path = score_optimiser.optimal_path();
+
+            BOOST_CHECK_EQUAL(score_path.score_boost, opt_path.score_boost);
+            BOOST_CHECK(score_path.activations.empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(time_budget_is_respected)
+
+BOOST_AUTO_TEST_CASE(exhausted_time_budget_gives_the_greedy_path)
+{
+    OptimiserSettings settings;
+    settings.time_budget = std::chrono::milliseconds {0};
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            const auto greedy_path = optimiser.greedy_path();
+            const auto opt_path = optimiser.optimal_path();
+
+            BOOST_CHECK(opt_path.is_possibly_suboptimal);
+            BOOST_CHECK_GT(opt_path.score_boost, 0);
+            BOOST_CHECK_EQUAL(opt_path.score_boost, greedy_path.score_boost);
+            BOOST_CHECK_EQUAL_COLLECTIONS(
+                opt_path.activations.cbegin(), opt_path.activations.cend(),
+                greedy_path.activations.cbegin(),
+                greedy_path.activations.cend());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(generous_time_budget_gives_optimal_path)
+{
+    OptimiserSettings settings;
+    settings.dp_engine = DpEngine::Iterative;
+    settings.time_budget = std::chrono::hours {1};
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            const auto track = make_test_song(chart);
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            const auto opt_path = optimiser.optimal_path();
+
+            BOOST_CHECK(!opt_path.is_possibly_suboptimal);
+            check_default_path(track, opt_path);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(checkpoints_are_used)
+
+BOOST_AUTO_TEST_CASE(interrupted_search_resumes_from_checkpoint)
+{
+    const auto checkpoint_file = std::filesystem::temp_directory_path()
+        / "chopt_optimiser_unittest.checkpoint";
+    OptimiserSettings settings;
+    settings.checkpoint_file = checkpoint_file;
+    const std::atomic<bool> halted {true};
+    for (auto chart : TEST_CHARTS) {
+        BOOST_TEST_CONTEXT("Chart " << chart)
+        {
+            std::filesystem::remove(checkpoint_file);
+            const auto track = make_test_song(chart);
+            const Optimiser halted_optimiser {
+                &track, &halted, 100, SightRead::Second(0.0), settings};
+
+            BOOST_CHECK_THROW([&] { return halted_optimiser.optimal_path(); }(),
+                              std::runtime_error);
+            BOOST_CHECK(std::filesystem::exists(checkpoint_file));
+
+            const Optimiser optimiser {&track, &term_bool, 100,
+                                       SightRead::Second(0.0), settings};
+            check_default_path(track, optimiser.optimal_path());
+            BOOST_CHECK(!std::filesystem::exists(checkpoint_file));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkpoints_for_other_songs_are_ignored)
+{
+    const auto track = make_test_song(TestChart::Taps);
+    const auto checkpoint_file = std::filesystem::temp_directory_path()
+        / "chopt_optimiser_unittest_other.checkpoint";
+    {
+        std::ofstream stream {checkpoint_file, std::ios::binary};
+        stream << "Not a checkpoint";
+    }
+    OptimiserSettings settings;
+    settings.checkpoint_file = checkpoint_file;
+    Optimiser optimiser {&track, &term_bool, 100, SightRead::Second(0.0),
+                         settings};
+    const auto opt_path = optimiser.optimal_path();
+
+    BOOST_CHECK_EQUAL(opt_path.score_boost, 150);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "pointptrrangeset.hpp"
+
+namespace {
+std::vector<Point> make_points(int count)
+{
+    const SpPosition position {SightRead::Beat {0.0}, SpMeasure {0.0}};
+    return std::vector<Point>(static_cast<std::size_t>(count),
+                              {position, position, position, std::nullopt, 50,
+                               50, false, false, false});
+}
+}
+
+BOOST_AUTO_TEST_SUITE(point_ptr_range_set_tracks_elements)
+
+BOOST_AUTO_TEST_CASE(elements_outside_the_range_are_never_contained)
+{
+    const auto points = make_points(10);
+    const PointPtrRangeSet set {points.cbegin() + 2, points.cend()};
+
+    BOOST_CHECK(!set.contains(points.cbegin()));
+    BOOST_CHECK(!set.contains(points.cend()));
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin() + 2);
+}
+
+BOOST_AUTO_TEST_CASE(out_of_order_elements_are_contained)
+{
+    const auto points = make_points(10);
+    PointPtrRangeSet set {points.cbegin(), points.cend()};
+
+    set.add(points.cbegin() + 3);
+    set.add(points.cbegin() + 7);
+
+    BOOST_CHECK(set.contains(points.cbegin() + 3));
+    BOOST_CHECK(set.contains(points.cbegin() + 7));
+    BOOST_CHECK(!set.contains(points.cbegin() + 4));
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin());
+}
+
+BOOST_AUTO_TEST_CASE(lowest_absent_element_skips_runs_across_words)
+{
+    const auto points = make_points(200);
+    PointPtrRangeSet set {points.cbegin(), points.cend()};
+
+    for (auto i = 1; i < 150; ++i) {
+        set.add(points.cbegin() + i);
+    }
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin());
+    set.add(points.cbegin());
+
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin() + 150);
+}
+
+BOOST_AUTO_TEST_CASE(lowest_absent_element_reaches_the_end)
+{
+    const auto points = make_points(64);
+    PointPtrRangeSet set {points.cbegin(), points.cend()};
+
+    for (auto p = points.cbegin(); p < points.cend(); ++p) {
+        set.add(p);
+    }
+
+    BOOST_CHECK(set.lowest_absent_element() == points.cend());
+}
+
+BOOST_AUTO_TEST_CASE(reset_sets_are_empty_over_their_new_range)
+{
+    const auto points = make_points(200);
+    PointPtrRangeSet set {points.cbegin() + 100, points.cend()};
+
+    for (auto i = 100; i < 200; i += 3) {
+        set.add(points.cbegin() + i);
+    }
+    set.reset(points.cbegin(), points.cend());
+
+    for (auto p = points.cbegin(); p < points.cend(); ++p) {
+        BOOST_CHECK(!set.contains(p));
+    }
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin());
+    set.add(points.cbegin() + 1);
+    set.add(points.cbegin());
+
+    BOOST_CHECK(set.lowest_absent_element() == points.cbegin() + 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
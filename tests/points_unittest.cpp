@@ -954,6 +954,67 @@ BOOST_AUTO_TEST_CASE(next_sp_granting_note_is_correct)
         std::prev(points.cend()));
 }
 
+BOOST_AUTO_TEST_CASE(point_index_lookups_match_point_ptr_lookups)
+{
+    std::vector<SightRead::Note> notes {make_note(100, 0), make_note(200, 100),
+                                        make_note(400, 0)};
+    std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {200}, SightRead::Tick {1}},
+        {SightRead::Tick {400}, SightRead::Tick {1}}};
+    SightRead::NoteTrack track {notes, phrases, SightRead::TrackType::FiveFret,
+                                std::make_unique<SightRead::SongGlobalData>()};
+
+    PointSet points {track,
+                     {{}, SpMode::Measure},
+                     {},
+                     SqueezeSettings::default_settings(),
+                     SightRead::DrumSettings::default_settings(),
+                     ChGuitarEngine()};
+
+    BOOST_CHECK_EQUAL(points.index_of(points.cend()), points.end_index());
+    for (PointIndex i = 0; i < points.end_index(); ++i) {
+        const auto p = points.ptr_at(i);
+        BOOST_CHECK_EQUAL(points.index_of(p), i);
+        BOOST_CHECK_EQUAL(&points[i], &*p);
+        BOOST_CHECK_EQUAL(points.ptr_at(points.next_sp_granting_note(i)),
+                          points.next_sp_granting_note(p));
+        BOOST_CHECK_EQUAL(points.ptr_at(points.next_non_hold_point(i)),
+                          points.next_non_hold_point(p));
+        BOOST_CHECK_EQUAL(points.ptr_at(points.first_after_current_phrase(i)),
+                          points.first_after_current_phrase(p));
+        BOOST_CHECK_EQUAL(points.range_score(i, points.end_index()),
+                          points.range_score(p, points.cend()));
+        BOOST_CHECK_EQUAL(points.is_hold_point(i), p->is_hold_point);
+        BOOST_CHECK_EQUAL(points.is_sp_granting_note(i),
+                          p->is_sp_granting_note);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(first_hit_window_end_after_is_correct)
+{
+    std::vector<SightRead::Note> notes {make_note(0), make_note(192),
+                                        make_note(384)};
+    SightRead::NoteTrack track {notes,
+                                {},
+                                SightRead::TrackType::FiveFret,
+                                std::make_unique<SightRead::SongGlobalData>()};
+
+    PointSet points {track,
+                     {{}, SpMode::Measure},
+                     {},
+                     SqueezeSettings::default_settings(),
+                     SightRead::DrumSettings::default_settings(),
+                     ChGuitarEngine()};
+    const auto second_end = std::next(points.cbegin())->hit_window_end;
+
+    BOOST_CHECK_EQUAL(points.first_hit_window_end_after(0, SpMeasure(-1.0)),
+                      0U);
+    BOOST_CHECK_EQUAL(
+        points.first_hit_window_end_after(0, second_end.sp_measure), 2U);
+    BOOST_CHECK_EQUAL(points.first_hit_window_end_after(2, SpMeasure(100.0)),
+                      points.end_index());
+}
+
 BOOST_AUTO_TEST_CASE(solo_sections_are_added)
 {
     std::vector<SightRead::Solo> solos {
@@ -999,6 +1060,29 @@ BOOST_AUTO_TEST_CASE(range_score_is_correct)
     BOOST_CHECK_EQUAL(points.range_score(begin + 1, end - 1), 28);
 }
 
+BOOST_AUTO_TEST_CASE(range_phrase_count_is_correct)
+{
+    SightRead::NoteTrack track {
+        {make_note(768), make_note(960), make_note(1152)},
+        {{SightRead::Tick {768}, SightRead::Tick {1}},
+         {SightRead::Tick {1100}, SightRead::Tick {53}}},
+        SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    PointSet points {track,
+                     {{}, SpMode::Measure},
+                     {{SightRead::Tick {1100}, SightRead::Tick {53}}},
+                     SqueezeSettings::default_settings(),
+                     SightRead::DrumSettings::default_settings(),
+                     Rb3Engine()};
+    const auto begin = points.cbegin();
+    const auto end = points.cend();
+
+    BOOST_CHECK_EQUAL(points.range_phrase_count(begin, begin), 0);
+    BOOST_CHECK_EQUAL(points.range_phrase_count(begin, end), 3);
+    BOOST_CHECK_EQUAL(points.range_phrase_count(begin + 1, end), 2);
+    BOOST_CHECK_EQUAL(points.range_phrase_count(begin, end - 1), 1);
+}
+
 BOOST_AUTO_TEST_CASE(colour_set_is_correct_for_five_fret)
 {
     std::vector<SightRead::Note> notes {
@@ -1186,6 +1270,31 @@ BOOST_AUTO_TEST_CASE(activation_notes_are_marked_with_drum_fills)
     BOOST_TEST(!(begin + 3)->fill_start.has_value());
 }
 
+BOOST_AUTO_TEST_CASE(next_fill_point_is_correct)
+{
+    std::vector<SightRead::Note> notes {make_drum_note(0), make_drum_note(192),
+                                        make_drum_note(385),
+                                        make_drum_note(576)};
+    std::vector<SightRead::DrumFill> fills {
+        {SightRead::Tick {384}, SightRead::Tick {5}}};
+    SightRead::NoteTrack track {notes,
+                                {},
+                                SightRead::TrackType::Drums,
+                                std::make_unique<SightRead::SongGlobalData>()};
+    track.drum_fills(fills);
+    PointSet points {track,
+                     {{}, SpMode::Measure},
+                     {},
+                     SqueezeSettings::default_settings(),
+                     SightRead::DrumSettings::default_settings(),
+                     ChDrumEngine()};
+    const auto begin = points.cbegin();
+
+    BOOST_CHECK_EQUAL(points.next_fill_point(begin), begin + 2);
+    BOOST_CHECK_EQUAL(points.next_fill_point(begin + 2), begin + 2);
+    BOOST_CHECK_EQUAL(points.next_fill_point(begin + 3), points.cend());
+}
+
 BOOST_AUTO_TEST_CASE(fills_ending_only_in_a_kick_are_not_killed)
 {
     std::vector<SightRead::Note> notes {
@@ -17,6 +17,9 @@
  */
 
 #include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <tuple>
 
 #include <boost/test/unit_test.hpp>
 
@@ -782,6 +785,77 @@ BOOST_AUTO_TEST_CASE(check_compressed_activations_are_counted)
                       ActValidity::success);
 }
 
+// The expected results are the ones is_candidate_valid gave before it was
+// built on ActEndSweep.
+BOOST_AUTO_TEST_CASE(act_end_sweep_gives_the_same_results_in_any_order)
+{
+    std::vector<SightRead::Note> notes {
+        make_note(0),    make_note(768),       make_note(1536),
+        make_note(2304), make_note(3072, 192), make_note(3840),
+        make_note(4608), make_note(5376),      make_note(6144),
+        make_note(6336), make_note(6528),      make_note(6912)};
+    std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {768}, SightRead::Tick {1}},
+        {SightRead::Tick {3072}, SightRead::Tick {100}}};
+    SightRead::NoteTrack note_track {
+        notes, phrases, SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    ProcessedSong track {note_track,
+                         {{}, SpMode::Measure},
+                         SqueezeSettings::default_settings(),
+                         SightRead::DrumSettings::default_settings(),
+                         ChGuitarEngine(),
+                         {},
+                         {}};
+    const auto& points = track.points();
+    const SpPosition earliest_point {SightRead::Beat(0.0), SpMeasure(0.0)};
+    const SpBar sp_bar {0.5, 0.5};
+    const auto neg_inf = -std::numeric_limits<double>::infinity();
+    ActEndSweep sweep {track,
+                       points.cbegin(),
+                       earliest_point,
+                       sp_bar,
+                       1.0,
+                       {SightRead::Beat {neg_inf}, SpMeasure {neg_inf}}};
+    // Every earlier act end, the sustain's hold points included, leaves SP to
+    // spare. The note on beat 33 can only be reached by whammying the
+    // sustain.
+    const std::vector<std::tuple<double, ActValidity, double>> last_notes {
+        {28.0, ActValidity::success, 32.0},
+        {32.0, ActValidity::success, 32.0},
+        {33.0, ActValidity::success, 32.86},
+        {34.0, ActValidity::insufficient_sp, 0.0},
+        {36.0, ActValidity::insufficient_sp, 0.0}};
+    const auto check_act_end = [&](auto act_end) {
+        auto expected_validity = ActValidity::surplus_sp;
+        auto expected_end = 0.0;
+        for (const auto& [beat, validity, ending_beat] : last_notes) {
+            if (act_end->position.beat.value() == beat) {
+                expected_validity = validity;
+                expected_end = ending_beat;
+            }
+        }
+        const auto result = sweep.check(act_end);
+        BOOST_TEST_CONTEXT("Act end at beat "
+                           << act_end->position.beat.value())
+        {
+            BOOST_CHECK_EQUAL(result.validity, expected_validity);
+            if (expected_validity == ActValidity::success) {
+                BOOST_CHECK_CLOSE(result.ending_position.beat.value(),
+                                  expected_end, 0.0001);
+            }
+        }
+    };
+
+    for (auto q = points.cbegin(); q < points.cend(); ++q) {
+        check_act_end(q);
+    }
+    // Going back to an earlier act end makes the sweep start again.
+    for (auto q = points.cend(); q > points.cbegin(); --q) {
+        check_act_end(std::prev(q));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(is_candidate_valid_takes_into_account_minimum_sp)
@@ -2068,3 +2142,53 @@ BOOST_AUTO_TEST_CASE(average_multiplier_is_ignored_with_rb)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(processed_songs_sharing_sp_data_keep_their_own_squeeze)
+{
+    std::vector<SightRead::Note> notes {make_note(0), make_note(3110)};
+    SightRead::NoteTrack note_track {
+        notes,
+        {},
+        SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    const SpTimeMap time_map {{}, SpMode::Measure};
+    auto squeeze_settings = SqueezeSettings::default_settings();
+    const auto sp_data = std::make_shared<const SpData>(
+        note_track, time_map, std::vector<SightRead::Tick> {},
+        squeeze_settings, ChGuitarEngine());
+    const ProcessedSong full_squeeze_track {
+        note_track,
+        time_map,
+        sp_data,
+        squeeze_settings,
+        SightRead::DrumSettings::default_settings(),
+        ChGuitarEngine(),
+        {}};
+    squeeze_settings.squeeze = 0.0;
+    const ProcessedSong no_squeeze_track {
+        note_track,
+        time_map,
+        sp_data,
+        squeeze_settings,
+        SightRead::DrumSettings::default_settings(),
+        ChGuitarEngine(),
+        {}};
+    const auto& full_points = full_squeeze_track.points();
+    const auto& no_points = no_squeeze_track.points();
+    ActivationCandidate full_candidate {full_points.cbegin(),
+                                        full_points.cbegin() + 1,
+                                        {SightRead::Beat(0.0), SpMeasure(0.0)},
+                                        {0.5, 0.5}};
+    ActivationCandidate no_candidate {no_points.cbegin(),
+                                      no_points.cbegin() + 1,
+                                      {SightRead::Beat(0.0), SpMeasure(0.0)},
+                                      {0.5, 0.5}};
+
+    BOOST_CHECK_EQUAL(&full_squeeze_track.sp_data(),
+                      &no_squeeze_track.sp_data());
+    BOOST_CHECK_EQUAL(
+        full_squeeze_track.is_candidate_valid(full_candidate).validity,
+        ActValidity::success);
+    BOOST_CHECK_NE(no_squeeze_track.is_candidate_valid(no_candidate).validity,
+                   ActValidity::success);
+}
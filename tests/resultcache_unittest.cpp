@@ -0,0 +1,125 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+#include <QTemporaryDir>
+
+#include "resultcache.hpp"
+#include "test_helpers.hpp"
+
+namespace {
+ProcessedSong make_processed_song(const std::vector<SightRead::Note>& notes)
+{
+    std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {0}, SightRead::Tick {50}},
+        {SightRead::Tick {192}, SightRead::Tick {50}}};
+    SightRead::NoteTrack note_track {
+        notes, phrases, SightRead::TrackType::FiveFret,
+        std::make_shared<SightRead::SongGlobalData>()};
+    return {note_track,
+            {{}, SpMode::Measure},
+            SqueezeSettings::default_settings(),
+            SightRead::DrumSettings::default_settings(),
+            ChGuitarEngine(),
+            {},
+            {}};
+}
+
+Settings make_settings()
+{
+    Settings settings {};
+    settings.game = Game::CloneHero;
+    settings.engine = std::make_unique<ChGuitarEngine>();
+    settings.instrument = SightRead::Instrument::Guitar;
+    settings.difficulty = SightRead::Difficulty::Expert;
+    settings.squeeze_settings = SqueezeSettings::default_settings();
+    settings.drum_settings = SightRead::DrumSettings::default_settings();
+    settings.speed = 100;
+    return settings;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(result_cache_stores_paths)
+
+BOOST_AUTO_TEST_CASE(stored_results_are_loaded_unchanged)
+{
+    const auto track
+        = make_processed_song({make_note(0), make_note(192), make_note(384)});
+    const auto& points = track.points();
+    const CachedResult result {
+        {{{points.cbegin() + 2, points.cbegin() + 2, SightRead::Beat {0.0},
+           SightRead::Beat {2.0}, SightRead::Beat {18.0}}},
+         50},
+        "Path: 2"};
+    const QTemporaryDir directory;
+    const ResultCache cache {directory.path().toStdString(), "key"};
+
+    cache.store(result, points);
+    const auto loaded_result = cache.load(points);
+
+    BOOST_REQUIRE(loaded_result.has_value());
+    BOOST_CHECK_EQUAL(loaded_result->path.score_boost, 50);
+    BOOST_CHECK_EQUAL_COLLECTIONS(loaded_result->path.activations.cbegin(),
+                                  loaded_result->path.activations.cend(),
+                                  result.path.activations.cbegin(),
+                                  result.path.activations.cend());
+    BOOST_CHECK_EQUAL(loaded_result->path_summary, "Path: 2");
+}
+
+BOOST_AUTO_TEST_CASE(missing_entries_are_not_loaded)
+{
+    const auto track = make_processed_song({make_note(0), make_note(192)});
+    const QTemporaryDir directory;
+    const ResultCache cache {directory.path().toStdString(), "key"};
+
+    BOOST_CHECK(!cache.load(track.points()).has_value());
+}
+
+BOOST_AUTO_TEST_CASE(entries_for_a_different_number_of_points_are_not_loaded)
+{
+    const auto track = make_processed_song({make_note(0), make_note(192)});
+    const auto other_track
+        = make_processed_song({make_note(0), make_note(192), make_note(384)});
+    const QTemporaryDir directory;
+    const ResultCache cache {directory.path().toStdString(), "key"};
+
+    cache.store({{{}, 0}, "Path: None"}, track.points());
+
+    BOOST_CHECK(!cache.load(other_track.points()).has_value());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(result_cache_key_depends_on_content_and_settings)
+{
+    const auto settings = make_settings();
+    auto faster_settings = make_settings();
+    faster_settings.speed = 150;
+    auto squeezed_settings = make_settings();
+    squeezed_settings.squeeze_settings.squeeze = 0.5;
+
+    const auto key = result_cache_key("abc", settings);
+
+    BOOST_CHECK_EQUAL(key, result_cache_key("abc", make_settings()));
+    BOOST_CHECK_NE(key, result_cache_key("abd", settings));
+    BOOST_CHECK_NE(key, result_cache_key("abc", faster_settings));
+    BOOST_CHECK_NE(key, result_cache_key("abc", squeezed_settings));
+}
@@ -312,6 +312,38 @@ BOOST_AUTO_TEST_CASE(is_in_whammy_ranges_works_correctly)
     BOOST_TEST(!sp_data.is_in_whammy_ranges(SightRead::Beat(11.0)));
 }
 
+BOOST_AUTO_TEST_CASE(whammy_equivalent_position_gives_the_same_whammy)
+{
+    std::vector<SightRead::Note> notes {make_note(0, 1920), make_note(2112),
+                                        make_note(2304, 768)};
+    std::vector<SightRead::StarPower> phrases {
+        {SightRead::Tick {0}, SightRead::Tick {3000}}};
+    SightRead::NoteTrack track {notes, phrases, SightRead::TrackType::FiveFret,
+                                std::make_shared<SightRead::SongGlobalData>()};
+    SpData sp_data {track,
+                    {{}, SpMode::Measure},
+                    {},
+                    SqueezeSettings::default_settings(),
+                    ChGuitarEngine()};
+    const SpPosition inside_range {SightRead::Beat(1.0), SpMeasure(0.25)};
+    const SpPosition between_ranges {SightRead::Beat(10.5),
+                                     SpMeasure(2.625)};
+    const SpPosition after_ranges {SightRead::Beat(20.0), SpMeasure(5.0)};
+
+    const auto gap_position
+        = sp_data.whammy_equivalent_position(between_ranges);
+    BOOST_CHECK_EQUAL(
+        sp_data.whammy_equivalent_position(inside_range).beat.value(), 1.0);
+    BOOST_CHECK_GT(gap_position.beat.value(), 10.5);
+    BOOST_TEST(sp_data.is_in_whammy_ranges(gap_position.beat));
+    BOOST_CHECK_EQUAL(
+        sp_data.available_whammy(gap_position.beat, SightRead::Beat(16.0)),
+        sp_data.available_whammy(between_ranges.beat, SightRead::Beat(16.0)));
+    BOOST_CHECK_CLOSE(
+        sp_data.whammy_equivalent_position(after_ranges).beat.value(), 16.0,
+        0.0001);
+}
+
 BOOST_AUTO_TEST_SUITE(available_whammy_works_correctly)
 
 BOOST_AUTO_TEST_CASE(max_early_whammy)
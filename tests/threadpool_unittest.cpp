@@ -0,0 +1,91 @@
+/*
+ * CHOpt - Star Power optimiser for Clone Hero
+ * Copyright (C) 2024 Raymond Wright
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <stdexcept>
+
+#include <boost/test/unit_test.hpp>
+
+#include "threadpool.hpp"
+
+BOOST_AUTO_TEST_SUITE(thread_pool_runs_tasks)
+
+BOOST_AUTO_TEST_CASE(all_tasks_are_run_before_wait_returns)
+{
+    ThreadPool pool {4};
+    std::atomic<int> count {0};
+    ThreadPool::TaskGroup group {pool};
+
+    for (auto i = 0; i < 1000; ++i) {
+        group.run([&] { ++count; });
+    }
+    group.wait();
+
+    BOOST_CHECK_EQUAL(count, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(single_thread_pool_runs_tasks_on_waiting_thread)
+{
+    ThreadPool pool {1};
+    auto count = 0;
+    ThreadPool::TaskGroup group {pool};
+
+    for (auto i = 0; i < 10; ++i) {
+        group.run([&] { ++count; });
+    }
+    group.wait();
+
+    BOOST_CHECK_EQUAL(count, 10);
+}
+
+BOOST_AUTO_TEST_CASE(tasks_can_wait_on_their_own_groups)
+{
+    ThreadPool pool {4};
+    std::atomic<int> count {0};
+    ThreadPool::TaskGroup group {pool};
+
+    for (auto i = 0; i < 20; ++i) {
+        group.run([&] {
+            ThreadPool::TaskGroup inner_group {pool};
+            for (auto j = 0; j < 20; ++j) {
+                inner_group.run([&] { ++count; });
+            }
+            inner_group.wait();
+        });
+    }
+    group.wait();
+
+    BOOST_CHECK_EQUAL(count, 400);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_CASE(exceptions_from_tasks_are_rethrown_by_wait)
+{
+    ThreadPool pool {2};
+    ThreadPool::TaskGroup group {pool};
+
+    group.run([] { throw std::runtime_error("Task failed"); });
+
+    BOOST_CHECK_THROW(group.wait(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_must_have_a_thread)
+{
+    BOOST_CHECK_THROW([] { return ThreadPool {0}; }(), std::invalid_argument);
+}